@@ -0,0 +1,107 @@
+#ifndef _ARCHIVE_HPP
+#define _ARCHIVE_HPP
+
+#include <zip.h>
+#include <sys/types.h>
+#include <cinttypes>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "options.hpp"
+
+namespace scalable_zip_fs {
+
+class ZipHandle;
+
+
+// Long-lived handles on a single ZIP archive, opened once at mount and
+// shared by every FUSE worker thread.
+//
+// The raw fd is used for pread on stored entries and may be used from any
+// thread. libzip handles are not thread-safe, so they are kept in a pool and
+// leased out one per reader (see ZipHandle); the pool grows to the number of
+// concurrent readers of compressed entries and is never shrunk.
+//
+// With read_mode=mmap the whole archive is additionally mapped read-only so
+// stored entries can be copied out without a syscall. With read_mode=direct a
+// second fd is opened with O_DIRECT, bypassing the page cache of the
+// underlying filesystem; reads are widened to the device alignment and go
+// through a bounce buffer.
+class Archive {
+public:
+    Archive(const std::string& path, size_t id);
+    ~Archive();
+
+    Archive(const Archive&) = delete;
+    Archive& operator=(const Archive&) = delete;
+
+    inline const std::string& path() const { return path_; }
+    inline size_t id() const { return id_; }
+    inline int fd() const { return fd_; }
+    inline uint64_t size() const { return size_; }
+    inline const char* data() const { return map_; }
+    inline bool mapped() const { return map_ != nullptr; }
+
+    inline bool direct() const { return direct_fd_ >= 0; }
+    inline size_t direct_alignment() const { return direct_align_; }
+
+    // Map the whole archive; returns false and leaves it unmapped on failure
+    bool map(bool populate, MadvisePolicy policy);
+
+    // Open the O_DIRECT fd. `alignment` of 0 asks the filesystem for it.
+    // Returns false and leaves direct() unset on failure.
+    bool open_direct(size_t alignment);
+
+    // pread that retries on EINTR; returns bytes read or -errno
+    ssize_t pread(void* buf, size_t len, uint64_t offset) const;
+
+    // Same, through the O_DIRECT fd and a bounce buffer from BufferPool
+    ssize_t pread_direct(void* buf, size_t len, uint64_t offset) const;
+
+    // Offset of the data of the entry whose local header is at
+    // `header_offset`, checked to leave room for `stored_size` bytes of it
+    // in the archive. Costs one small read; returns -errno on failure.
+    int64_t data_offset(uint64_t header_offset, uint64_t stored_size) const;
+
+protected:
+    zip_t* acquire_zip();
+    void release_zip(zip_t* za);
+
+    ssize_t read_fd(int fd, void* buf, size_t len, uint64_t offset) const;
+
+    std::string path_;
+    size_t id_;
+    int fd_;
+    uint64_t size_;
+    char* map_;
+    int direct_fd_;
+    size_t direct_align_;
+
+    std::mutex zip_pool_mutex_;
+    std::vector<zip_t*> zip_pool_;
+
+    friend ZipHandle;
+};
+
+
+// RAII lease of a libzip handle from an Archive's pool
+class ZipHandle {
+public:
+    explicit ZipHandle(Archive& archive) : archive_(archive), za_(archive.acquire_zip()) { }
+    ~ZipHandle() { if (za_) archive_.release_zip(za_); }
+
+    ZipHandle(const ZipHandle&) = delete;
+    ZipHandle& operator=(const ZipHandle&) = delete;
+
+    inline zip_t* get() const { return za_; }
+    inline explicit operator bool() const { return za_ != nullptr; }
+
+protected:
+    Archive& archive_;
+    zip_t* za_;
+};
+
+}
+
+#endif
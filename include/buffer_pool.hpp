@@ -0,0 +1,62 @@
+#ifndef _BUFFER_POOL_HPP
+#define _BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace scalable_zip_fs {
+
+class BounceBuffer;
+
+
+// Pool of equally sized, aligned buffers for O_DIRECT reads. Buffers are
+// allocated on demand, so the pool grows to the number of concurrent
+// readers, and are only freed when the pool is destroyed.
+class BufferPoolImpl {
+public:
+    BufferPoolImpl();
+    ~BufferPoolImpl();
+
+    // Must be called before the first buffer is handed out
+    void configure(size_t alignment, size_t buffer_size);
+
+    inline size_t alignment() const { return alignment_; }
+    inline size_t buffer_size() const { return buffer_size_; }
+
+protected:
+    char* acquire();
+    void release(char* buf);
+
+    size_t alignment_;
+    size_t buffer_size_;
+
+    std::mutex mutex_;
+    std::vector<char*> free_;
+
+    friend BounceBuffer;
+};
+
+typedef Singleton<BufferPoolImpl> BufferPool;
+
+
+// RAII lease of one buffer from the pool; data() is nullptr on allocation failure
+class BounceBuffer {
+public:
+    BounceBuffer() : buf_(BufferPool::get_instance().acquire()) { }
+    ~BounceBuffer() { if (buf_) BufferPool::get_instance().release(buf_); }
+
+    BounceBuffer(const BounceBuffer&) = delete;
+    BounceBuffer& operator=(const BounceBuffer&) = delete;
+
+    inline char* data() const { return buf_; }
+
+protected:
+    char* buf_;
+};
+
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef _DIRENT_CACHE_HPP
+#define _DIRENT_CACHE_HPP
+
+#include <atomic>
+#include <cinttypes>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "utils.hpp"
+#include "zipent.hpp"
+
+namespace scalable_zip_fs {
+
+// A whole directory listing, serialized as the kernel expects it
+// (struct fuse_dirent or fuse_direntplus records, one per position).
+struct DirentBuffer {
+    std::vector<char> data;
+    std::vector<size_t> offsets;    // Start of each entry, then data.size()
+
+    inline size_t num_entries() const { return offsets.size() - 1; }
+    inline size_t bytes() const { return data.size() + offsets.size() * sizeof(size_t); }
+
+    // Byte range of the entries from position `pos` on that fit in `size`
+    std::pair<size_t, size_t> slice(size_t pos, size_t size) const;
+};
+
+typedef std::shared_ptr<const DirentBuffer> DirentData;
+
+
+// Serialized listings of the low-level frontend, kept per directory and
+// kind (plain or plus) within a byte budget.
+//
+// A directory's buffer is built on its first listing; every later readdir
+// of it is a slice of that buffer. Least recently used listings are dropped
+// when the budget is exceeded, and a listing that alone exceeds the budget
+// is remembered so it is not built again.
+class DirentCacheImpl {
+public:
+    DirentCacheImpl();
+
+    void configure(size_t budget);
+
+    inline bool enabled() const { return budget_ > 0; }
+
+    // Whether a listing of `dir` may be cached at all
+    bool cacheable(const DirectoryEntry* dir, bool plus) const;
+
+    // Cached listing of `dir`, or null; counts a hit or a miss
+    DirentData lookup(const DirectoryEntry* dir, bool plus);
+
+    // Cache `data` as the listing of `dir`
+    void insert(const DirectoryEntry* dir, bool plus, DirentData data);
+
+    inline uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    inline uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+    size_t bytes() const;
+
+protected:
+    // DirectoryEntry records hold only 32-bit fields, so their addresses are
+    // 4-byte aligned and the low bit is free for `plus`
+    static inline uintptr_t key_for(const DirectoryEntry* dir, bool plus) {
+        return reinterpret_cast<uintptr_t>(dir) | (plus ? 1 : 0);
+    }
+
+    size_t budget_;
+    size_t used_;
+
+    mutable std::mutex mutex_;
+    std::list<std::pair<uintptr_t, DirentData>> lru_;    // Front: most recent
+    std::unordered_map<uintptr_t, decltype(lru_)::iterator> listings_;
+    std::unordered_set<uintptr_t> oversized_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+};
+
+typedef Singleton<DirentCacheImpl> DirentCache;
+
+}
+
+#endif
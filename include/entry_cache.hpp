@@ -0,0 +1,85 @@
+#ifndef _ENTRY_CACHE_HPP
+#define _ENTRY_CACHE_HPP
+
+#include <atomic>
+#include <cinttypes>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "utils.hpp"
+#include "zipent.hpp"
+
+namespace scalable_zip_fs {
+
+typedef std::shared_ptr<const std::vector<char>> CachedData;
+
+
+// Fully decompressed contents of small compressed entries.
+//
+// The cache is split into shards by entry so concurrent opens rarely share
+// a lock. Each shard gets an equal part of the byte budget and evicts with
+// the CLOCK algorithm: a hit sets the slot's reference bit, and the hand
+// clears bits until it finds an unreferenced slot to drop. Data is handed
+// out as shared pointers, so eviction never invalidates an open file.
+class EntryCacheImpl {
+public:
+    EntryCacheImpl();
+
+    void configure(size_t budget, size_t max_entry_size);
+
+    inline bool enabled() const { return budget_ > 0; }
+
+    // Whether `entry` is small enough to be cached
+    bool cacheable(const FileEntry* entry) const;
+
+    // Cached contents of `entry`, or null; counts a hit or a miss
+    CachedData lookup(const FileEntry* entry);
+
+    // Cache `data` for `entry` and return what is now cached for it
+    CachedData insert(const FileEntry* entry, std::vector<char>&& data);
+
+    inline uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    inline uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+    inline uint64_t evictions() const { return evictions_.load(std::memory_order_relaxed); }
+    size_t bytes() const;
+    size_t entries() const;
+
+protected:
+    static constexpr size_t kNumShards = 16;
+
+    struct Slot {
+        const FileEntry* entry = nullptr;
+        CachedData data;
+        bool referenced = false;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<const FileEntry*, size_t> slot_of;
+        std::vector<Slot> slots;
+        std::vector<size_t> free_slots;
+        size_t hand = 0;
+        size_t bytes = 0;
+    };
+
+    Shard& shard_for(const FileEntry* entry);
+    void make_room(Shard& shard, size_t needed);
+
+    size_t budget_;
+    size_t shard_budget_;
+    size_t max_entry_size_;
+
+    Shard shards_[kNumShards];
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> evictions_;
+};
+
+typedef Singleton<EntryCacheImpl> EntryCache;
+
+}
+
+#endif
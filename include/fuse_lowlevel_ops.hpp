@@ -0,0 +1,41 @@
+#ifndef _FUSE_LOWLEVEL_OPS_HPP
+#define _FUSE_LOWLEVEL_OPS_HPP
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse3/fuse_lowlevel.h>
+
+namespace scalable_zip_fs {
+
+// Inode based frontend (-o lowlevel). Node ids are index positions (see
+// ZipEntryManagerImpl::inode), so a lookup is one child search in the
+// parent directory and every other op goes straight to its entry; there
+// is no path tree in libfuse and no path to resolve again.
+void zipfs_ll_init(void *userdata, struct fuse_conn_info *conn);
+void zipfs_ll_destroy(void *userdata);
+void zipfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name);
+void zipfs_ll_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup);
+void zipfs_ll_forget_multi(fuse_req_t req, size_t count, struct fuse_forget_data *forgets);
+void zipfs_ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+void zipfs_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+void zipfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset,
+                   struct fuse_file_info *fi);
+void zipfs_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+void zipfs_ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+void zipfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset,
+                      struct fuse_file_info *fi);
+void zipfs_ll_readdirplus(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset,
+                          struct fuse_file_info *fi);
+void zipfs_ll_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name, size_t size);
+void zipfs_ll_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size);
+
+// Get FUSE low-level operations structure
+struct fuse_lowlevel_ops* get_zipfs_lowlevel_operations();
+
+// Equivalent of fuse_main() for the low-level frontend: parse the FUSE
+// command line in `args`, mount, and serve requests until unmounted
+int zipfs_lowlevel_main(struct fuse_args* args);
+
+} // namespace scalable_zip_fs
+
+#endif
@@ -7,16 +7,42 @@
 
 namespace scalable_zip_fs {
 
+class DirectoryEntry;
+class FileEntry;
+class FileHandle;
+
+// Shared by the high-level and low-level frontends
+void zipfs_configure_conn(struct fuse_conn_info *conn);
+void zipfs_stat_dir(const DirectoryEntry& dir, struct stat *stbuf);
+void zipfs_stat_file(const FileEntry& file, struct stat *stbuf);
+
+// Name and attributes of the entry at `pos` in a listing of `dir`: ".",
+// "..", the subdirectories by name, then the files in listing order (see
+// ZipEntryManagerImpl::listed_file). Positions are stable for the
+// whole mount, so both frontends use pos + 1 as the readdir offset.
+// Returns false past the last entry.
+bool zipfs_dirent_at(const DirectoryEntry& dir, size_t pos, const char*& name, struct stat *stbuf);
+
+// Make `bufv` a single buffer describing up to `size` bytes at `offset` of
+// an open file: the archive fd for spliced reads, or malloc()ed memory
+// holding the data. Returns 0 or -errno.
+int zipfs_fill_bufvec(FileHandle& fh, size_t size, off_t offset, struct fuse_bufvec& bufv);
+
 // FUSE operation callbacks
 void* zipfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg);
 void zipfs_destroy(void *private_data);
 int zipfs_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
+int zipfs_opendir(const char *path, struct fuse_file_info *fi);
 int zipfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
                   off_t offset, struct fuse_file_info *fi,
                   enum fuse_readdir_flags flags);
 int zipfs_open(const char *path, struct fuse_file_info *fi);
 int zipfs_read(const char *path, char *buf, size_t size, off_t offset,
                struct fuse_file_info *fi);
+int zipfs_read_buf(const char *path, struct fuse_bufvec **bufp, size_t size,
+                   off_t offset, struct fuse_file_info *fi);
+int zipfs_getxattr(const char *path, const char *name, char *value, size_t size);
+int zipfs_listxattr(const char *path, char *list, size_t size);
 int zipfs_release(const char *path, struct fuse_file_info *fi);
 
 // Get FUSE operations structure
@@ -0,0 +1,144 @@
+#ifndef _INFLATE_HPP
+#define _INFLATE_HPP
+
+#include <zlib.h>
+#include <sys/types.h>
+#include <atomic>
+#include <cinttypes>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "archive.hpp"
+#include "utils.hpp"
+#include "zipent.hpp"
+
+namespace scalable_zip_fs {
+
+constexpr size_t kInflateWindowSize = 32768;
+
+
+// Saved decoder state at a deflate block boundary: enough to resume
+// decompression at `out` without decoding anything before it.
+struct InflateCheckpoint {
+    uint64_t out;           // Uncompressed offset
+    uint64_t in;            // Compressed offset of the first unconsumed byte
+    int bits;               // Bits of the byte at in - 1 still to be consumed
+    size_t window_size;
+    unsigned char window[kInflateWindowSize];
+};
+
+
+// Raw deflate decoder over one entry, reading compressed bytes straight
+// from the archive. It only moves forward; reset() rewinds it to the start
+// of the entry or to a checkpoint.
+class InflateStream {
+public:
+    typedef std::function<void(std::shared_ptr<const InflateCheckpoint>)> CheckpointFn;
+
+    // `data_offset` is where the entry's compressed data starts in `archive`
+    InflateStream(const FileEntry* entry, Archive* archive, uint64_t data_offset);
+    ~InflateStream();
+
+    InflateStream(const InflateStream&) = delete;
+    InflateStream& operator=(const InflateStream&) = delete;
+
+    // Restart at `cp`, or at the beginning of the entry if null; returns 0 or -errno
+    int reset(const InflateCheckpoint* cp);
+
+    // Uncompressed offset of the next byte the stream will produce
+    inline uint64_t position() const { return out_; }
+
+    // Report a checkpoint at the first block boundary at or after `next_at`,
+    // then every `span` bytes after that
+    void record_checkpoints(uint64_t next_at, uint64_t span, CheckpointFn fn);
+
+    // Decode forward to `offset` (which must not be behind position()),
+    // then copy up to `size` bytes into `buf`; returns bytes copied or -errno
+    ssize_t read(char* buf, size_t size, uint64_t offset);
+
+protected:
+    int fill_input();
+    std::shared_ptr<InflateCheckpoint> make_checkpoint() const;
+
+    const FileEntry* entry_;
+    Archive* archive_;
+    uint64_t data_offset_;
+
+    z_stream strm_;
+    bool initialized_;
+    bool finished_;
+
+    uint64_t out_;          // Uncompressed bytes produced so far
+    uint64_t in_read_;      // Compressed bytes read from the archive so far
+
+    std::vector<unsigned char> input_;
+    std::vector<unsigned char> window_;     // Circular, last 32 KiB of output
+    size_t window_pos_;
+
+    uint64_t checkpoint_next_;
+    uint64_t checkpoint_span_;
+    CheckpointFn on_checkpoint_;
+};
+
+
+// Lazily built random access indexes for deflated entries.
+//
+// A read at any offset resumes from the nearest checkpoint at or before it,
+// so it decodes at most one span plus the requested bytes. Checkpoints are
+// recorded as a side effect of reads and kept in a memory pool bounded by a
+// byte budget; when the budget is exceeded the indexes of the least recently
+// used entries are dropped and rebuilt on demand.
+class InflateIndexImpl {
+public:
+    InflateIndexImpl();
+
+    void configure(size_t span, size_t budget);
+
+    // Decompress up to `size` bytes at `offset` of the entry whose data
+    // starts at `data_offset`; returns bytes read or -errno
+    ssize_t read(const FileEntry* entry, Archive& archive, uint64_t data_offset,
+                 char* buf, size_t size, off_t offset);
+
+    // Rewind `stream` to the nearest checkpoint at or before `offset` and
+    // let it extend the index as it moves on; returns 0 or -errno
+    int seek(InflateStream& stream, const FileEntry* entry, uint64_t offset);
+
+    // Nearest checkpoint at or before `offset`, or null; records the use
+    std::shared_ptr<const InflateCheckpoint> find(const FileEntry* entry, uint64_t offset,
+                                                  uint64_t& frontier);
+
+    // Offer a checkpoint to the entry's index
+    void add(const FileEntry* entry, std::shared_ptr<const InflateCheckpoint> cp);
+
+    inline size_t span() const { return span_; }
+    inline size_t memory_used() const { return used_.load(std::memory_order_relaxed); }
+
+protected:
+    struct EntryIndex {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<const InflateCheckpoint>> points;   // Sorted by out
+        size_t bytes = 0;
+        bool evicted = false;
+    };
+
+    std::shared_ptr<EntryIndex> get_index(const FileEntry* entry, bool create);
+    void evict();
+
+    size_t span_;
+    size_t budget_;
+    std::atomic<size_t> used_;
+
+    std::mutex mutex_;
+    std::list<std::pair<const FileEntry*, std::shared_ptr<EntryIndex>>> lru_;   // Front: most recent
+    std::unordered_map<const FileEntry*, decltype(lru_)::iterator> indexes_;
+};
+
+typedef Singleton<InflateIndexImpl> InflateIndex;
+
+}
+
+#endif
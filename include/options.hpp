@@ -0,0 +1,80 @@
+#ifndef _OPTIONS_HPP
+#define _OPTIONS_HPP
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse3/fuse_opt.h>
+#include <string>
+
+#include "utils.hpp"
+
+namespace scalable_zip_fs {
+
+// How stored entries are read from the archive
+enum class ReadMode {
+    PREAD,      // pread on the archive fd
+    MMAP,       // memcpy from a read-only mapping of the whole archive
+    DIRECT,     // O_DIRECT pread through aligned bounce buffers
+};
+
+// madvise() hint applied to archive mappings
+enum class MadvisePolicy {
+    NORMAL,
+    RANDOM,
+    SEQUENTIAL,
+    WILLNEED,
+};
+
+
+// Order of the files in a directory listing
+enum class ListingOrder {
+    NAME,       // Byte-wise by name
+    OFFSET,     // By position in the archive, for sequential reads
+};
+
+// Cache timeout that never runs out in practice; the index is immutable
+constexpr double kForeverTimeout = 1e9;
+
+// Largest FUSE request the kernel allows (256 pages of max_pages)
+constexpr unsigned kMaxRequestKb = 1024;
+
+
+// Filesystem specific mount options, given as -o key[=value]
+struct MountOptions {
+    ReadMode read_mode = ReadMode::PREAD;
+    MadvisePolicy madvise = MadvisePolicy::NORMAL;
+    bool populate = false;
+    unsigned direct_align = 0;      // 0: ask the filesystem
+    bool splice = true;
+    unsigned inflate_span_mb = 1;       // Checkpoint spacing in deflated entries
+    unsigned inflate_index_mb = 256;    // Memory budget for all checkpoints
+    unsigned cache_mb = 256;            // Budget for decompressed small entries
+    unsigned cache_max_entry_kb = 1024; // Largest entry kept in that cache
+    bool no_cache = false;
+    unsigned prefetch_kb = 8192;        // Largest cross-entry readahead window; 0 disables
+    unsigned max_request_kb = 1024;     // Largest read request (kernel max_pages)
+    unsigned max_readahead_kb = 0;      // 0: whatever the kernel offers
+    unsigned max_background = 64;       // Outstanding async (readahead) requests
+    unsigned congestion_threshold = 0;  // 0: 3/4 of max_background
+    unsigned index_threads = 0;         // 0: max(16, cores)
+    std::string index_cache;            // Directory for index snapshots; empty: none
+    bool lowlevel = false;              // Serve the inode based low-level FUSE API
+    double entry_timeout = kForeverTimeout;     // Seconds the kernel caches names
+    double attr_timeout = kForeverTimeout;      // Seconds the kernel caches attributes
+    double negative_timeout = kForeverTimeout;  // Seconds the kernel caches misses; 0 disables
+    unsigned dirent_cache_mb = 64;      // Budget for serialized listings (lowlevel); 0 disables
+    ListingOrder readdir_order = ListingOrder::NAME;
+};
+
+typedef Singleton<MountOptions> MountConfig;
+
+
+// Strip the options above from `args` into `opts`, leaving FUSE options in
+// place. Returns false (after printing a message) on an invalid value.
+bool parse_mount_options(struct fuse_args* args, MountOptions& opts);
+
+void print_mount_options_help();
+
+}
+
+#endif
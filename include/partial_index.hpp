@@ -0,0 +1,52 @@
+#ifndef _PARTIAL_INDEX_HPP
+#define _PARTIAL_INDEX_HPP
+
+#include <cinttypes>
+#include <memory>
+#include <vector>
+
+#include "archive.hpp"
+
+namespace scalable_zip_fs {
+
+// One file of an archive as read from its central directory, before it
+// is placed in the tree. The name lives in PartialIndex::names.
+struct PartialEntry {
+    uint64_t name_offset;
+    uint64_t size;
+    uint64_t compressed_size;
+    uint64_t header_offset;  // Absolute offset of the entry's local header
+    uint64_t zip_index;
+    uint32_t name_len;
+    uint16_t compression_method;
+    uint8_t encrypted;
+    uint8_t reserved;
+};
+
+// Everything learned from one archive, independent of every other archive.
+// `entries` and `names` point at the storage vectors (see use_storage()).
+struct PartialIndex {
+    std::unique_ptr<Archive> archive;
+
+    const PartialEntry* entries = nullptr;  // Central directory order, no directories
+    size_t num_entries = 0;
+    const char* names = nullptr;            // All entry names, back to back
+    size_t names_size = 0;
+    uint64_t skipped_dirs = 0;
+    uint64_t skipped_invalid = 0;           // Out of bounds, or too large for the index
+
+    std::vector<PartialEntry> entry_storage;
+    std::vector<char> name_storage;
+
+    // Point `entries` and `names` at the storage vectors
+    inline void use_storage() {
+        entries = entry_storage.data();
+        num_entries = entry_storage.size();
+        names = name_storage.data();
+        names_size = name_storage.size();
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef _PREFETCH_HPP
+#define _PREFETCH_HPP
+
+#include <atomic>
+#include <cinttypes>
+#include <memory>
+#include <mutex>
+
+#include "archive.hpp"
+#include "utils.hpp"
+
+namespace scalable_zip_fs {
+
+// Readahead across entry boundaries.
+//
+// Kernel readahead on a FUSE file stops at the end of that file, so a
+// loader walking a directory whose files sit back to back in the archive
+// starts every file cold. This watches the archive offsets touched by
+// opens and reads; once accesses keep moving forward it asks the kernel
+// to read ahead in the archive itself (posix_fadvise WILLNEED), which
+// covers the entries that follow in archive order. The window doubles
+// with every sequential access up to a maximum and collapses as soon as
+// an access lands elsewhere.
+class PrefetcherImpl {
+public:
+    PrefetcherImpl();
+
+    // `max_window` of 0 disables prefetching
+    void configure(size_t num_archives, size_t max_window);
+
+    inline bool enabled() const { return max_window_ > 0; }
+
+    // Record an access to [offset, offset + len) of `archive`
+    void access(const Archive& archive, uint64_t offset, uint64_t len);
+
+    inline uint64_t issued_bytes() const { return issued_bytes_.load(std::memory_order_relaxed); }
+    inline uint64_t resets() const { return resets_.load(std::memory_order_relaxed); }
+
+protected:
+    struct Stream {
+        std::mutex mutex;
+        uint64_t pos = 0;           // Furthest offset accessed so far
+        uint64_t issued = 0;        // Prefetched up to here
+        size_t window = 0;          // 0 until the stream looks sequential
+        unsigned hits = 0;
+    };
+
+    size_t num_archives_;
+    size_t max_window_;
+    std::unique_ptr<Stream[]> streams_;
+
+    std::atomic<uint64_t> issued_bytes_;
+    std::atomic<uint64_t> resets_;
+};
+
+typedef Singleton<PrefetcherImpl> Prefetcher;
+
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef _READER_HPP
+#define _READER_HPP
+
+#include <zip.h>
+#include <sys/types.h>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+#include "archive.hpp"
+#include "entry_cache.hpp"
+#include "inflate.hpp"
+#include "zipent.hpp"
+
+namespace scalable_zip_fs {
+
+// How the data of an open file is produced
+enum class ReadStrategy {
+    PREAD,      // Stored entry: pread straight from the archive fd
+    MMAP,       // Stored entry: memcpy from the archive mapping
+    DIRECT,     // Stored entry: O_DIRECT read through a bounce buffer
+    CACHED,     // Compressed entry held fully decompressed in EntryCache
+    INFLATE,    // Deflated entry: raw inflate from the nearest checkpoint
+    LIBZIP,     // Other compressed or encrypted entries: decode through libzip
+};
+
+
+// Per-open state, allocated by open() and carried in fuse_file_info::fh so
+// that reads never resolve the path again. The entry's local header is
+// read once, on open or on the first read of a handle that was never
+// opened, and the data offset behind it is kept here.
+//
+// For compressed entries the handle also keeps a live decoder and its
+// position, so a reader going front to back continues where the previous
+// read stopped instead of starting over. FUSE may issue concurrent reads on
+// one handle; only one of them uses the live decoder at a time, the others
+// fall back to a fresh decoder.
+class FileHandle {
+public:
+    FileHandle(const FileEntry* entry, Archive* archive);
+    ~FileHandle();
+
+    FileHandle(const FileHandle&) = delete;
+    FileHandle& operator=(const FileHandle&) = delete;
+
+    inline const FileEntry* entry() const { return entry_; }
+    inline Archive& archive() const { return *archive_; }
+    inline ReadStrategy strategy() const { return strategy_; }
+
+    // Offset of the entry's data in the archive; valid after resolve()
+    inline uint64_t data_offset() const { return data_offset_; }
+
+    // Read the local header unless that was done already. Returns 0 or -errno.
+    int resolve();
+
+    // Work done once per open: small compressed entries are decompressed
+    // into (or found in) the entry cache. Returns 0 or -errno.
+    int open();
+
+    // Read up to `size` bytes at `offset`; returns bytes read or -errno
+    int read(char* buf, size_t size, off_t offset);
+
+protected:
+    static constexpr uint64_t kUnresolved = UINT64_MAX;
+
+    int read_inflate(char* buf, size_t size, off_t offset);
+    int read_libzip(char* buf, size_t size, off_t offset);
+    int read_libzip_once(char* buf, size_t size, off_t offset);
+    void close_zip_file();
+
+    const FileEntry* entry_;
+    Archive* archive_;
+    ReadStrategy strategy_;
+    uint64_t data_offset_;  // kUnresolved until resolve() succeeds
+    CachedData cached_;
+
+    // Live decoder state, guarded by stream_mutex_
+    std::mutex stream_mutex_;
+    std::unique_ptr<InflateStream> inflate_;
+    std::unique_ptr<ZipHandle> zip_;
+    zip_file_t* zip_file_;
+    uint64_t zip_pos_;
+};
+
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef _SNAPSHOT_HPP
+#define _SNAPSHOT_HPP
+
+#include <cinttypes>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "archive.hpp"
+#include "zipent.hpp"
+
+namespace scalable_zip_fs {
+
+// What a snapshot must match for each archive it was built from
+struct SnapshotKey {
+    std::string path;           // Absolute archive path
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t cd_crc32;          // CRC-32 of the central directory
+};
+
+
+// On-disk copy of a whole frozen index (see FrozenIndex).
+//
+// The file is a fixed header, the key of every archive in mount order and
+// the frozen arrays, and is used in place through a read-only mapping:
+// loading it costs one mmap and bounds checks, and nothing is rebuilt.
+// Snapshots that do not match their keys, were written for the other
+// listing order or another version, or fail the checks are ignored.
+class IndexSnapshot {
+public:
+    ~IndexSnapshot();
+
+    IndexSnapshot(const IndexSnapshot&) = delete;
+    IndexSnapshot& operator=(const IndexSnapshot&) = delete;
+
+    // Key of `archive` as it is now; reads its central directory
+    static SnapshotKey key_for(const Archive& archive);
+
+    // Snapshot file for the archives `keys` in the cache directory `dir`
+    static std::filesystem::path file_for(const std::filesystem::path& dir, const std::vector<SnapshotKey>& keys,
+                                          bool by_offset);
+
+    // Map `file` if it is a valid snapshot for `keys`, else return null
+    static std::shared_ptr<const IndexSnapshot> load(const std::filesystem::path& file,
+                                                     const std::vector<SnapshotKey>& keys, bool by_offset);
+
+    // Write `index` to `file` atomically; returns false on failure
+    static bool save(const std::filesystem::path& file, const std::vector<SnapshotKey>& keys,
+                     const FrozenIndex& index);
+
+    // The arrays, pointing into the mapping
+    inline const FrozenIndex& index() const { return index_; }
+
+protected:
+    IndexSnapshot() : map_(nullptr), size_(0), index_() { }
+
+    const char* map_;
+    size_t size_;
+    FrozenIndex index_;
+};
+
+}
+
+#endif
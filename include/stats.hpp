@@ -0,0 +1,36 @@
+#ifndef _STATS_HPP
+#define _STATS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "utils.hpp"
+
+namespace scalable_zip_fs {
+
+// Extended attribute, available on the mount root, that reports runtime
+// counters as "name value" lines:
+//   getfattr --only-values -n user.zipfs.stats /mount/point
+constexpr const char* kStatsXattr = "user.zipfs.stats";
+
+std::string format_stats();
+
+
+// Metadata requests that reached the daemon, i.e. that the kernel could
+// not answer from its dentry and attribute caches
+struct RequestStats {
+    std::atomic<uint64_t> lookups{0};
+    std::atomic<uint64_t> getattrs{0};
+    std::atomic<uint64_t> readdirs{0};
+};
+
+typedef Singleton<RequestStats> RequestCounters;
+
+inline void count_request(std::atomic<uint64_t>& counter) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+}
+
+#endif
@@ -1,7 +1,10 @@
 #ifndef _UTILS_HPP
 #define _UTILS_HPP
 
-#include <list>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
 #include <tuple>
 
 namespace scalable_zip_fs {
@@ -26,24 +29,76 @@ protected:
 };
 
 
+// Segments of a PathSplit: a small vector of (start, end) offsets that
+// keeps up to kInline of them inline and only goes to the heap for
+// deeper paths.
+class PathSegments {
+public:
+    typedef std::tuple<size_t, size_t> value_type;
+    typedef const value_type* const_iterator;
+
+    static constexpr size_t kInline = 32;
+
+    PathSegments() : data_(reinterpret_cast<value_type*>(inline_)), size_(0), capacity_(kInline) { }
+    ~PathSegments();
+
+    PathSegments(const PathSegments&) = delete;
+    PathSegments& operator=(const PathSegments&) = delete;
+
+    inline size_t size() const { return size_; }
+    inline bool empty() const { return size_ == 0; }
+    inline const_iterator begin() const { return data_; }
+    inline const_iterator end() const { return data_ + size_; }
+    inline const value_type& front() const { return data_[0]; }
+    inline const value_type& back() const { return data_[size_ - 1]; }
+
+    inline void push_back(size_t start, size_t end) {
+        if (size_ == capacity_) {
+            grow();
+        }
+        new (data_ + size_++) value_type(start, end);
+    }
+    inline void pop_back() { size_--; }
+
+protected:
+    void grow();
+
+    value_type* data_;
+    size_t size_;
+    size_t capacity_;
+    // Left uninitialized: constructing a PathSplit costs nothing per slot
+    alignas(value_type) unsigned char inline_[kInline * sizeof(value_type)];
+};
+
+
+// Splits a path into its segments without allocating (for up to
+// PathSegments::kInline segments). Empty segments and "." are dropped,
+// ".." removes the segment before it; a path ending in '/', "." or ".."
+// names a directory.
 class PathSplit {
 public:
     PathSplit(const std::string& path);
     PathSplit(const char* pathptr, const size_t pathlen);
-    
-    inline const std::list<std::tuple<size_t, size_t>>& segments() {
+
+    inline const PathSegments& segments() const {
         return segments_;
     }
-    
+
     inline bool is_dir() const {
         return is_dir_;
     }
 
 protected:
-    std::list< std::tuple < size_t, size_t > > segments_;
+    PathSegments segments_;
     bool is_dir_;
 };
 
+// Offset of the first '/' in p[0, len), or len if there is none
+size_t find_separator(const char* p, size_t len);
+
+// Fast non-cryptographic 64-bit hash (wyhash construction)
+uint64_t hash_bytes(const char* data, size_t len);
+
 size_t get_common_path_split(const char* str_a, const size_t len_a, const PathSplit& split_a);
 
 }
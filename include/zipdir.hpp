@@ -0,0 +1,100 @@
+#ifndef _ZIPDIR_HPP
+#define _ZIPDIR_HPP
+
+#include <sys/types.h>
+#include <cinttypes>
+#include <string>
+#include <vector>
+
+namespace scalable_zip_fs {
+
+// Fixed part of a local file header, before its name and extra field
+constexpr uint64_t kLocalHeaderSize = 30;
+
+// Length of the local file header whose fixed part is `header`, name and
+// extra field included; 0 if `header` is not a local file header. The
+// local name and extra field may differ from the central ones, so where
+// an entry's data starts is only known once its local header is read.
+uint64_t local_header_length(const unsigned char* header);
+
+
+// One central directory record. `name` points into the mapping and is not
+// NUL terminated. Sizes and offsets already have their ZIP64 values applied.
+struct CentralRecord {
+    const char* name;
+    size_t name_len;
+    uint64_t size;
+    uint64_t compressed_size;
+    uint64_t local_header_offset;
+    uint32_t crc32;
+    uint16_t flags;             // General purpose bit flag
+    uint16_t method;
+
+    inline bool encrypted() const { return flags & 0x0001; }
+};
+
+
+// A run of consecutive records: from `pos` up to the next range's `pos`.
+// `index` is the central directory index of its first record.
+struct DirectoryRange {
+    uint64_t pos;
+    uint64_t index;
+};
+
+
+// Read-only view of a ZIP archive's central directory.
+//
+// The archive is mapped for the lifetime of the object and records are
+// decoded straight from the mapping, without copying the directory or
+// building an intermediate entry table. Sizes are always taken from the
+// central directory, so entries written with a data descriptor (whose
+// local headers carry zero sizes) are handled like any other.
+//
+// Local headers are never read here: each one sits next to its entry's
+// data, so reading them all would touch a page per entry across the
+// whole archive. Readers resolve them on open instead (see
+// Archive::data_offset()).
+//
+// Malformed archives are reported with std::runtime_error.
+class CentralDirectory {
+public:
+    CentralDirectory(int fd, const std::string& path);
+    ~CentralDirectory();
+
+    CentralDirectory(const CentralDirectory&) = delete;
+    CentralDirectory& operator=(const CentralDirectory&) = delete;
+
+    inline uint64_t num_entries() const { return num_entries_; }
+    inline uint64_t archive_size() const { return size_; }
+
+    // CRC-32 of the raw directory bytes
+    uint32_t checksum() const;
+
+    // Position of the first record, for next()
+    inline uint64_t begin() const { return 0; }
+
+    // Decode the record at `pos` (relative to the start of the directory)
+    // and advance `pos` past it; returns false at the end of the directory
+    bool next(uint64_t& pos, CentralRecord& rec) const;
+
+    // Cut the directory at record boundaries into at most `parts` ranges of
+    // about `num_entries() / parts` records each. Only the fixed header of
+    // each record is read. The result ends with a sentinel at the end of
+    // the last record.
+    std::vector<DirectoryRange> split(size_t parts) const;
+
+protected:
+    void locate();
+
+    std::string path_;
+    const unsigned char* map_;
+    uint64_t size_;
+
+    const unsigned char* cd_;
+    uint64_t cd_size_;
+    uint64_t num_entries_;
+};
+
+}
+
+#endif
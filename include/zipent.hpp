@@ -2,12 +2,16 @@
 #define _ZIPENT_HPP
 
 #include <string>
+#include <string_view>
+#include <span>
 #include <vector>
-#include <unordered_map>
 #include <memory>
 #include <cinttypes>
 #include <filesystem>
+#include <functional>
 
+#include "archive.hpp"
+#include "partial_index.hpp"
 #include "utils.hpp"
 
 
@@ -15,71 +19,315 @@ namespace scalable_zip_fs {
 
 class FileEntry;
 class DirectoryEntry;
+class IndexSnapshot;
 class ZipEntryManagerImpl;
 
 
+// Details only compressed (or encrypted) entries need; kept in a side
+// table so stored entries do not pay for them
+struct CompressedInfo {
+    uint64_t header_offset;  // Absolute offset of the entry's local header
+    uint64_t compressed_size;
+    uint32_t zip_index;      // ZIP entry index (for libzip)
+    uint16_t compression_method;
+    bool encrypted;
+    uint8_t reserved;        // Index snapshots store records as they are, padding included
+};
+
+static_assert(sizeof(CompressedInfo) == 24, "CompressedInfo is meant to stay 24 bytes");
+
+
+// A file in the frozen index. Records are 24 bytes and live in one array,
+// grouped by directory and sorted by name within each group. Names and
+// the parent are ids into the index arrays, so the records hold no
+// pointers and the arrays can be moved or mapped as they are.
+//
+// Records hold where the entry's local header is, not its data: the data
+// follows the header's variable length name and extra field, which are
+// only read when the file is opened (see Archive::data_offset()).
+//
+// Sizes are 48 bits and header offsets 47 bits, split into a low word and
+// a high half word so the record needs only 4 byte alignment. The top bit
+// of offset_hi_ marks a compressed entry, whose offset_lo_ is then an
+// index into the CompressedInfo table, which holds its header offset
+// instead.
 class FileEntry {
 public:
-    DirectoryEntry* parent_;
+    static constexpr uint64_t kMaxSize = (uint64_t(1) << 48) - 1;
+    static constexpr uint64_t kMaxOffset = (uint64_t(1) << 47) - 1;
 
-    inline const std::string& name() const { return *name_; }
-    inline size_t size() const { return size_; }
+    inline std::string_view name() const;
+    // Name in the arena `names`, for loops that fetch it once
+    inline std::string_view name(const char* names) const { return std::string_view(names + name_, name_len_); }
+    inline const char* c_name() const;
+    inline const DirectoryEntry* parent() const;
+    inline size_t size() const { return uint64_t(size_hi_) << 32 | size_lo_; }
     inline size_t zip_path_idx() const { return zip_path_idx_; }
-    inline size_t offset() const { return offset_; }
-    inline bool need_decompression() const { return need_decompression_; }
+    inline size_t header_offset() const;
+    // Header offset with the CompressedInfo table `compressed`, for loops that fetch it once
+    inline size_t header_offset(const CompressedInfo* compressed) const {
+        return need_decompression() ? compressed[offset_lo_].header_offset : uint64_t(offset_hi_) << 32 | offset_lo_;
+    }
+    inline bool need_decompression() const { return (offset_hi_ & kCompressed) != 0; }
+
+    size_t zip_index() const;
+    size_t compressed_size() const;
+    uint16_t compression_method() const;
+    bool encrypted() const;
 
 protected:
-    const std::string* name_;
+    static constexpr uint16_t kCompressed = 0x8000;
 
-    size_t zip_path_idx_;
-    size_t size_;
-    size_t compressed_size_;
-    size_t offset_;          // ZIP entry index
-    bool need_decompression_;
+    uint32_t name_;          // Offset of the NUL terminated name in the name arena
+    uint32_t parent_;        // Id of the directory holding the file
+    uint32_t size_lo_;
+    uint32_t offset_lo_;     // Header offset, or the CompressedInfo index if compressed
+    uint16_t size_hi_;
+    uint16_t offset_hi_;     // kCompressed, and the header offset above offset_lo_
+    uint16_t name_len_;
+    uint16_t zip_path_idx_;
 
     friend ZipEntryManagerImpl;
 };
 
+static_assert(sizeof(FileEntry) == 24, "FileEntry is meant to stay 24 bytes");
+
 
+// A directory in the frozen index. Its subdirectories and files are
+// contiguous, name-sorted runs of the directory and file arrays, given by
+// the id of their first entry and a count.
 class DirectoryEntry {
 public:
-    inline const std::string& name() const { return *name_; }
-    inline const std::unordered_map<std::string, std::unique_ptr<DirectoryEntry>>& dirs() const { return dirs_; }
-    inline const std::unordered_map<std::string, std::unique_ptr<FileEntry>>& files() const { return files_; }
+    inline std::string_view name() const;
+    // Name in the arena `names`, for loops that fetch it once
+    inline std::string_view name(const char* names) const { return std::string_view(names + name_, name_len_); }
+    inline const char* c_name() const;
+    inline const DirectoryEntry* parent() const;
+    inline std::span<const DirectoryEntry> dirs() const;
+    inline std::span<const FileEntry> files() const;
 
-    const DirectoryEntry* find_dir(const std::string& name) const;
-    const FileEntry* find_file(const std::string& name) const;
+    const DirectoryEntry* find_dir(std::string_view name) const;
+    const FileEntry* find_file(std::string_view name) const;
 
 protected:
-    std::unordered_map<std::string, std::unique_ptr<DirectoryEntry>> dirs_;
-    std::unordered_map<std::string, std::unique_ptr<FileEntry>> files_;
-    DirectoryEntry* parent_;
-    const std::string* name_;
+    static constexpr uint32_t kNoParent = UINT32_MAX;
+
+    uint32_t name_;          // Offset of the NUL terminated name in the name arena
+    uint32_t name_len_;
+    uint32_t parent_;        // Id of the parent directory, kNoParent for the root
+    uint32_t first_dir_;
+    uint32_t num_dirs_;
+    uint32_t first_file_;
+    uint32_t num_files_;
 
     friend ZipEntryManagerImpl;
 };
 
 
+// The frozen arrays of an index, wherever they live
+struct FrozenIndex {
+    const char* names;
+    size_t names_size;
+    const DirectoryEntry* dirs;
+    size_t num_dirs;
+    const FileEntry* files;
+    size_t num_files;
+    const CompressedInfo* compressed;
+    size_t num_compressed;
+    const uint8_t* path_tags;
+    const uint32_t* path_refs;
+    size_t path_capacity;
+    const uint32_t* listing_order;  // Null for name order
+};
+
+
+// Builds the index from a set of archives and serves lookups from it.
+//
+// Archives are parsed into PartialIndexes, then the whole tree is built
+// in one pass and frozen: names go to a single arena, directories and
+// files to two flat arrays, and entries refer to each other by position.
+// Nothing is added after that, so every FileEntry and DirectoryEntry
+// pointer stays valid for the whole mount. Since the arrays hold no
+// pointers, they can also be written out whole and mapped back on a later
+// mount of the same archives (see IndexSnapshot).
+//
+// Canonical paths, which is what FUSE passes, are looked up in one probe
+// sequence of an open addressing table keyed by a hash of the full path;
+// a hit is confirmed by comparing names up the parent chain. Anything
+// else (".", "..", repeated slashes) is resolved a component at a time.
 class ZipEntryManagerImpl {
 public:
     ZipEntryManagerImpl();
 
-    void index_zipfile(const std::filesystem::path& path);
+    // Parse `paths` on up to `threads` threads and build the index; on a
+    // duplicate path the earliest archive wins. May only be called once.
+    void index_zipfiles(const std::vector<std::filesystem::path>& paths, unsigned threads);
+
+    // Reuse and write index snapshots in `dir` (see IndexSnapshot)
+    inline void set_index_cache(const std::filesystem::path& dir) { index_cache_ = dir; }
+
+    // Make listings return each directory's files in archive order
+    // (archive, then offset) instead of by name, so reading them in
+    // listing order reads the archives sequentially. Set before indexing.
+    inline void set_listing_by_offset(bool by_offset) { listing_by_offset_ = by_offset; }
 
     const DirectoryEntry* lookup_dir(const char* path) const;
     const FileEntry* lookup_file(const char* path) const;
 
-    inline const DirectoryEntry& root() const { return root_; }
-    inline const std::string& get_zip_path(size_t idx) const { return zip_path_lst_[idx]; }
+    inline const DirectoryEntry& root() const { return dirs_[0]; }
+    inline const std::string& get_zip_path(size_t idx) const { return archives_[idx]->path(); }
+    inline Archive& archive(size_t idx) const { return *archives_[idx]; }
+    inline size_t num_archives() const { return archives_.size(); }
+
+    inline size_t num_files() const { return num_files_; }
+    inline size_t num_dirs() const { return num_dirs_; }
+
+    // Inode numbers are positions in the frozen arrays: the root is 1
+    // (FUSE_ROOT_ID), other directories follow it, then all files
+    inline uint64_t inode(const DirectoryEntry* dir) const { return (dir - dirs_) + 1; }
+    inline uint64_t inode(const FileEntry* file) const { return num_dirs_ + 1 + (file - files_); }
+    inline const DirectoryEntry* dir_by_inode(uint64_t ino) const {
+        return ino >= 1 && ino <= num_dirs_ ? &dirs_[ino - 1] : nullptr;
+    }
+    inline const FileEntry* file_by_inode(uint64_t ino) const {
+        return ino > num_dirs_ && ino - num_dirs_ <= num_files_ ? &files_[ino - num_dirs_ - 1] : nullptr;
+    }
+    inline const CompressedInfo& compressed_info(uint32_t idx) const { return compressed_[idx]; }
+    inline const CompressedInfo* compressed_table() const { return compressed_; }
+
+    // Resolve the ids stored in entries
+    inline const char* name_at(uint32_t offset) const { return names_ + offset; }
+    inline const DirectoryEntry* dir_at(uint32_t id) const { return dirs_ + id; }
+    inline const FileEntry* file_at(uint32_t id) const { return files_ + id; }
+
+    // File `i` of `dir` in listing order
+    inline const FileEntry& listed_file(const DirectoryEntry& dir, size_t i) const {
+        return files_[listing_order_ ? listing_order_[dir.first_file_ + i] : dir.first_file_ + i];
+    }
+
+    // Bytes held by the frozen index
+    size_t memory_used() const;
 
 protected:
-    std::vector<std::string> zip_path_lst_;
-    DirectoryEntry root_;
+    struct BuildState;
+
+    // The path table is two parallel arrays of slots: a one byte tag from
+    // the top of the hash (0 for an empty slot), which is all most probes
+    // look at, and a file id, or a directory id with kDirBit set
+    static constexpr uint32_t kDirBit = 0x80000000u;
+    static constexpr uint32_t kNotFound = UINT32_MAX;
+
+    static inline uint8_t path_tag(uint64_t hash) {
+        uint8_t tag = hash >> 56;
+        return tag ? tag : 1;
+    }
+
+    // The table is sized to the entries rather than to a power of two, so
+    // the home slot scales 31 hash bits below the tag to the capacity,
+    // which stays under 2^33
+    static inline size_t path_slot(uint64_t hash, size_t capacity) {
+        return ((hash >> 25) & 0x7FFFFFFF) * capacity >> 31;
+    }
+
+    // Parse `archives` (opening each through `open_archive` first) and
+    // freeze the tree they make
+    void build(std::vector<std::unique_ptr<Archive>>& archives,
+               const std::function<void(size_t)>& open_archive, unsigned threads);
+
+    // `threads` > 1 lets a large central directory be parsed in ranges
+    PartialIndex parse_archive(std::unique_ptr<Archive> archive, unsigned threads) const;
+    void merge(PartialIndex&& partial, BuildState& state);
+    void freeze(BuildState& state);
+    void build_path_table();
+    void sort_listings_by_offset();
+
+    // Serve the index mapped from `snapshot` if it holds together for
+    // `archives`, which are taken over then
+    bool use_snapshot(std::shared_ptr<const IndexSnapshot> snapshot,
+                      std::vector<std::unique_ptr<Archive>>& archives);
+    bool consistent(const FrozenIndex& index, const std::vector<std::unique_ptr<Archive>>& archives) const;
+    FrozenIndex frozen() const;
+
+    // Take ownership of a built array and return where it lives
+    template <typename T>
+    const T* keep(std::unique_ptr<T[]> array) {
+        const T* data = array.get();
+        storage_.emplace_back(std::move(array));
+        return data;
+    }
+
+    // Probe the path table for `path` (no leading '/'); `dir` selects the kind
+    uint32_t find_path(const char* path, size_t len, bool dir) const;
+    bool matches(const DirectoryEntry* dir, const char* path, size_t len) const;
+
+    const DirectoryEntry* walk_dir(const char* path) const;
+    const FileEntry* walk_file(const char* path) const;
+
+    std::vector<std::unique_ptr<Archive>> archives_;
+    std::filesystem::path index_cache_;
+    bool listing_by_offset_;
+
+    // The frozen arrays, in storage_ or in the mapped snapshot_
+    const char* names_;
+    size_t names_size_;
+    const DirectoryEntry* dirs_;
+    size_t num_dirs_;
+    const FileEntry* files_;
+    size_t num_files_;
+    const CompressedInfo* compressed_;
+    size_t num_compressed_;
+
+    const uint8_t* path_tags_;
+    const uint32_t* path_refs_;
+    size_t path_capacity_;
+
+    // File ids in listing order, grouped like files_; null for name order
+    const uint32_t* listing_order_;
+
+    std::vector<std::shared_ptr<const void>> storage_;
+    std::shared_ptr<const IndexSnapshot> snapshot_;
 };
 
 
 typedef Singleton<ZipEntryManagerImpl> ZipEntryManager;
 
+
+inline std::string_view FileEntry::name() const {
+    return name(ZipEntryManager::get_instance().name_at(0));
+}
+
+inline const char* FileEntry::c_name() const {
+    return ZipEntryManager::get_instance().name_at(name_);
+}
+
+inline size_t FileEntry::header_offset() const {
+    return header_offset(ZipEntryManager::get_instance().compressed_table());
+}
+
+inline const DirectoryEntry* FileEntry::parent() const {
+    return ZipEntryManager::get_instance().dir_at(parent_);
+}
+
+inline std::string_view DirectoryEntry::name() const {
+    return name(ZipEntryManager::get_instance().name_at(0));
+}
+
+inline const char* DirectoryEntry::c_name() const {
+    return ZipEntryManager::get_instance().name_at(name_);
+}
+
+inline const DirectoryEntry* DirectoryEntry::parent() const {
+    return parent_ == kNoParent ? nullptr : ZipEntryManager::get_instance().dir_at(parent_);
+}
+
+inline std::span<const DirectoryEntry> DirectoryEntry::dirs() const {
+    return std::span<const DirectoryEntry>(ZipEntryManager::get_instance().dir_at(first_dir_), num_dirs_);
+}
+
+inline std::span<const FileEntry> DirectoryEntry::files() const {
+    return std::span<const FileEntry>(ZipEntryManager::get_instance().file_at(first_file_), num_files_);
+}
+
 }
 
 #endif
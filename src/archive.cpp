@@ -0,0 +1,207 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "archive.hpp"
+#include "buffer_pool.hpp"
+#include "zipdir.hpp"
+
+namespace scalable_zip_fs {
+
+Archive::Archive(const std::string& path, size_t id)
+    : path_(path), id_(id), map_(nullptr), direct_fd_(-1), direct_align_(0) {
+    fd_ = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        throw std::runtime_error("Failed to open ZIP file: " + path_ + " - " + std::strerror(errno));
+    }
+
+    struct stat sb;
+    if (fstat(fd_, &sb) != 0) {
+        int saved_errno = errno;
+        close(fd_);
+        throw std::runtime_error("Failed to stat ZIP file: " + path_ + " - " + std::strerror(saved_errno));
+    }
+    size_ = sb.st_size;
+}
+
+Archive::~Archive() {
+    for (zip_t* za : zip_pool_) {
+        zip_discard(za);
+    }
+    if (map_) {
+        munmap(map_, size_);
+    }
+    if (direct_fd_ >= 0) {
+        close(direct_fd_);
+    }
+    close(fd_);
+}
+
+bool Archive::map(bool populate, MadvisePolicy policy) {
+    if (map_ || size_ == 0) {
+        return map_ != nullptr;
+    }
+
+    int flags = MAP_SHARED;
+    if (populate) {
+        flags |= MAP_POPULATE;
+    }
+
+    void* addr = mmap(nullptr, size_, PROT_READ, flags, fd_, 0);
+    if (addr == MAP_FAILED) {
+        std::cerr << "Warning: Failed to mmap " << path_ << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    int advice = MADV_NORMAL;
+    switch (policy) {
+    case MadvisePolicy::NORMAL:     advice = MADV_NORMAL; break;
+    case MadvisePolicy::RANDOM:     advice = MADV_RANDOM; break;
+    case MadvisePolicy::SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+    case MadvisePolicy::WILLNEED:   advice = MADV_WILLNEED; break;
+    }
+    if (advice != MADV_NORMAL && madvise(addr, size_, advice) != 0) {
+        std::cerr << "Warning: madvise failed on " << path_ << ": " << std::strerror(errno) << std::endl;
+    }
+
+    map_ = static_cast<char*>(addr);
+    return true;
+}
+
+bool Archive::open_direct(size_t alignment) {
+    if (direct_fd_ >= 0) {
+        return true;
+    }
+
+    int fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+    if (fd < 0) {
+        std::cerr << "Warning: O_DIRECT not supported for " << path_ << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (alignment == 0) {
+        alignment = 4096;
+#ifdef STATX_DIOALIGN
+        struct statx stx;
+        if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 &&
+            (stx.stx_mask & STATX_DIOALIGN) && stx.stx_dio_offset_align > 0) {
+            alignment = std::max<size_t>(stx.stx_dio_offset_align, stx.stx_dio_mem_align);
+        }
+#endif
+    }
+
+    direct_fd_ = fd;
+    direct_align_ = alignment;
+    return true;
+}
+
+ssize_t Archive::read_fd(int fd, void* buf, size_t len, uint64_t offset) const {
+    ssize_t n;
+    do {
+        n = ::pread(fd, buf, len, offset);
+    } while (n < 0 && errno == EINTR);
+    return n < 0 ? -errno : n;
+}
+
+ssize_t Archive::pread(void* buf, size_t len, uint64_t offset) const {
+    return read_fd(fd_, buf, len, offset);
+}
+
+int64_t Archive::data_offset(uint64_t header_offset, uint64_t stored_size) const {
+    if (header_offset > size_ || kLocalHeaderSize > size_ - header_offset) {
+        return -EIO;
+    }
+
+    unsigned char header[kLocalHeaderSize];
+    if (map_) {
+        std::memcpy(header, map_ + header_offset, sizeof(header));
+    } else {
+        ssize_t n = read_fd(fd_, header, sizeof(header), header_offset);
+        if (n < 0) {
+            return n;
+        }
+        if ((size_t)n != sizeof(header)) {
+            return -EIO;
+        }
+    }
+
+    uint64_t length = local_header_length(header);
+    uint64_t available = size_ - header_offset;
+    if (length == 0 || length > available || stored_size > available - length) {
+        return -EIO;
+    }
+    return header_offset + length;
+}
+
+ssize_t Archive::pread_direct(void* buf, size_t len, uint64_t offset) const {
+    auto& pool = BufferPool::get_instance();
+    size_t align = std::max(direct_align_, pool.alignment());
+    char* dst = static_cast<char*>(buf);
+    ssize_t total = 0;
+
+    while (len > 0) {
+        // Widen [offset, offset + len) to whole aligned blocks; block aligned
+        // entries and reads need no extra bytes
+        uint64_t start = offset / align * align;
+        size_t head = offset - start;
+        size_t span = (head + len + align - 1) / align * align;
+        span = std::min(span, pool.buffer_size());
+
+        BounceBuffer bounce;
+        if (!bounce.data()) {
+            return total > 0 ? total : -ENOMEM;
+        }
+
+        ssize_t n = read_fd(direct_fd_, bounce.data(), span, start);
+        if (n < 0) {
+            return total > 0 ? total : n;
+        }
+        if ((size_t)n <= head) {
+            break;  // End of file
+        }
+
+        size_t got = std::min((size_t)n - head, len);
+        std::memcpy(dst, bounce.data() + head, got);
+        dst += got;
+        total += got;
+        offset += got;
+        len -= got;
+
+        if ((size_t)n < span) {
+            break;  // End of file
+        }
+    }
+    return total;
+}
+
+zip_t* Archive::acquire_zip() {
+    {
+        std::lock_guard<std::mutex> lock(zip_pool_mutex_);
+        if (!zip_pool_.empty()) {
+            zip_t* za = zip_pool_.back();
+            zip_pool_.pop_back();
+            return za;
+        }
+    }
+
+    // Pool exhausted: open another handle outside the lock
+    int err = 0;
+    zip_t* za = zip_open(path_.c_str(), ZIP_RDONLY, &err);
+    if (za == nullptr) {
+        std::cerr << "Failed to open ZIP file: " << path_ << std::endl;
+    }
+    return za;
+}
+
+void Archive::release_zip(zip_t* za) {
+    std::lock_guard<std::mutex> lock(zip_pool_mutex_);
+    zip_pool_.push_back(za);
+}
+
+} // namespace scalable_zip_fs
@@ -0,0 +1,44 @@
+#include <cstdlib>
+
+#include "buffer_pool.hpp"
+
+namespace scalable_zip_fs {
+
+BufferPoolImpl::BufferPoolImpl() : alignment_(4096), buffer_size_(1024 * 1024) { }
+
+BufferPoolImpl::~BufferPoolImpl() {
+    for (char* buf : free_) {
+        std::free(buf);
+    }
+}
+
+void BufferPoolImpl::configure(size_t alignment, size_t buffer_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (char* buf : free_) {
+        std::free(buf);
+    }
+    free_.clear();
+
+    alignment_ = alignment;
+    // Whole number of aligned blocks
+    buffer_size_ = (buffer_size + alignment - 1) / alignment * alignment;
+}
+
+char* BufferPoolImpl::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty()) {
+            char* buf = free_.back();
+            free_.pop_back();
+            return buf;
+        }
+    }
+    return static_cast<char*>(std::aligned_alloc(alignment_, buffer_size_));
+}
+
+void BufferPoolImpl::release(char* buf) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(buf);
+}
+
+} // namespace scalable_zip_fs
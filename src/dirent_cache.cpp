@@ -0,0 +1,82 @@
+#include <algorithm>
+
+#include "dirent_cache.hpp"
+
+namespace scalable_zip_fs {
+
+static_assert(alignof(DirectoryEntry) > 1, "The low bit of a DirectoryEntry pointer must be free");
+
+std::pair<size_t, size_t> DirentBuffer::slice(size_t pos, size_t size) const {
+    if (pos >= num_entries()) {
+        return std::make_pair(data.size(), data.size());
+    }
+
+    // Last entry boundary that is at most `size` bytes past the start
+    size_t start = offsets[pos];
+    auto it = std::upper_bound(offsets.begin() + pos, offsets.end(), start + size);
+    return std::make_pair(start, *std::prev(it));
+}
+
+DirentCacheImpl::DirentCacheImpl()
+    : budget_(0), used_(0), hits_(0), misses_(0) { }
+
+void DirentCacheImpl::configure(size_t budget) {
+    budget_ = budget;
+}
+
+bool DirentCacheImpl::cacheable(const DirectoryEntry* dir, bool plus) const {
+    if (!enabled()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    return oversized_.count(key_for(dir, plus)) == 0;
+}
+
+DirentData DirentCacheImpl::lookup(const DirectoryEntry* dir, bool plus) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = listings_.find(key_for(dir, plus));
+    if (it == listings_.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    lru_.splice(lru_.begin(), lru_, it->second);
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return it->second->second;
+}
+
+void DirentCacheImpl::insert(const DirectoryEntry* dir, bool plus, DirentData data) {
+    uintptr_t key = key_for(dir, plus);
+    size_t cost = data->bytes();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // No amount of eviction makes room for a listing over the budget. Mark
+    // the directory so later readdirs fill each reply directly instead of
+    // serializing the whole listing again only to throw it away.
+    if (cost > budget_) {
+        oversized_.insert(key);
+        return;
+    }
+    if (listings_.count(key)) {
+        return;     // Another reader got there first
+    }
+
+    while (used_ + cost > budget_ && !lru_.empty()) {
+        used_ -= lru_.back().second->bytes();
+        listings_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+
+    lru_.emplace_front(key, std::move(data));
+    listings_.emplace(key, lru_.begin());
+    used_ += cost;
+}
+
+size_t DirentCacheImpl::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_;
+}
+
+} // namespace scalable_zip_fs
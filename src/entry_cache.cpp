@@ -0,0 +1,116 @@
+#include <functional>
+
+#include "entry_cache.hpp"
+
+namespace scalable_zip_fs {
+
+EntryCacheImpl::EntryCacheImpl()
+    : budget_(0), shard_budget_(0), max_entry_size_(0), hits_(0), misses_(0), evictions_(0) { }
+
+void EntryCacheImpl::configure(size_t budget, size_t max_entry_size) {
+    budget_ = budget;
+    shard_budget_ = budget / kNumShards;
+    max_entry_size_ = max_entry_size;
+}
+
+bool EntryCacheImpl::cacheable(const FileEntry* entry) const {
+    return enabled() && entry->size() <= max_entry_size_ && entry->size() <= shard_budget_;
+}
+
+EntryCacheImpl::Shard& EntryCacheImpl::shard_for(const FileEntry* entry) {
+    return shards_[std::hash<const FileEntry*>()(entry) % kNumShards];
+}
+
+CachedData EntryCacheImpl::lookup(const FileEntry* entry) {
+    Shard& shard = shard_for(entry);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.slot_of.find(entry);
+    if (it == shard.slot_of.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Slot& slot = shard.slots[it->second];
+    slot.referenced = true;
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return slot.data;
+}
+
+void EntryCacheImpl::make_room(Shard& shard, size_t needed) {
+    // Every slot is visited at most twice: once to clear its bit, once to evict
+    while (shard.bytes + needed > shard_budget_ && !shard.slot_of.empty()) {
+        if (shard.hand >= shard.slots.size()) {
+            shard.hand = 0;
+        }
+
+        Slot& slot = shard.slots[shard.hand];
+        if (slot.entry != nullptr) {
+            if (slot.referenced) {
+                slot.referenced = false;
+            } else {
+                shard.bytes -= slot.data->size();
+                shard.slot_of.erase(slot.entry);
+                shard.free_slots.push_back(shard.hand);
+                slot = Slot();
+                evictions_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        shard.hand++;
+    }
+}
+
+CachedData EntryCacheImpl::insert(const FileEntry* entry, std::vector<char>&& data) {
+    auto cached = std::make_shared<const std::vector<char>>(std::move(data));
+    if (!cacheable(entry)) {
+        return cached;
+    }
+
+    Shard& shard = shard_for(entry);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Another open may have filled it in the meantime
+    auto it = shard.slot_of.find(entry);
+    if (it != shard.slot_of.end()) {
+        return shard.slots[it->second].data;
+    }
+
+    make_room(shard, cached->size());
+
+    size_t idx;
+    if (!shard.free_slots.empty()) {
+        idx = shard.free_slots.back();
+        shard.free_slots.pop_back();
+    } else {
+        idx = shard.slots.size();
+        shard.slots.emplace_back();
+    }
+
+    Slot& slot = shard.slots[idx];
+    slot.entry = entry;
+    slot.data = cached;
+    slot.referenced = false;
+    shard.slot_of.emplace(entry, idx);
+    shard.bytes += cached->size();
+    return cached;
+}
+
+size_t EntryCacheImpl::bytes() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.bytes;
+    }
+    return total;
+}
+
+size_t EntryCacheImpl::entries() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.slot_of.size();
+    }
+    return total;
+}
+
+} // namespace scalable_zip_fs
@@ -0,0 +1,362 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+
+#include "dirent_cache.hpp"
+#include "fuse_lowlevel_ops.hpp"
+#include "fuse_ops.hpp"
+#include "options.hpp"
+#include "reader.hpp"
+#include "stats.hpp"
+#include "zipent.hpp"
+
+namespace scalable_zip_fs {
+
+namespace {
+
+// Attributes of inode `ino`; false if there is no such inode
+bool stat_inode(fuse_ino_t ino, struct stat* stbuf) {
+    auto& manager = ZipEntryManager::get_instance();
+    if (const DirectoryEntry* dir = manager.dir_by_inode(ino)) {
+        zipfs_stat_dir(*dir, stbuf);
+        return true;
+    }
+    if (const FileEntry* file = manager.file_by_inode(ino)) {
+        zipfs_stat_file(*file, stbuf);
+        return true;
+    }
+    return false;
+}
+
+// Serialize entry `pos` of `dir` into `buf` as fuse_add_direntry(_plus)
+// does; returns the size it needs, which is more than `bufsize` if it did
+// not fit
+size_t add_dirent(fuse_req_t req, char* buf, size_t bufsize, const DirectoryEntry& dir,
+                  size_t pos, bool plus, bool& found) {
+    const char* name;
+    struct fuse_entry_param e;
+    std::memset(&e, 0, sizeof(e));
+    found = zipfs_dirent_at(dir, pos, name, &e.attr);
+    if (!found) {
+        return 0;
+    }
+    // The offset of an entry is its position plus one
+    if (plus) {
+        e.ino = e.attr.st_ino;
+        e.attr_timeout = MountConfig::get_instance().attr_timeout;
+        e.entry_timeout = MountConfig::get_instance().entry_timeout;
+        return fuse_add_direntry_plus(req, buf, bufsize, name, &e, pos + 1);
+    }
+    return fuse_add_direntry(req, buf, bufsize, name, &e.attr, pos + 1);
+}
+
+// The whole listing of `dir`, serialized
+DirentData build_dirents(fuse_req_t req, const DirectoryEntry& dir, bool plus) {
+    auto dirents = std::make_shared<DirentBuffer>();
+    dirents->offsets.reserve(dir.dirs().size() + dir.files().size() + 3);
+
+    bool found;
+    for (size_t pos = 0; ; pos++) {
+        size_t start = dirents->data.size();
+        size_t len = add_dirent(req, nullptr, 0, dir, pos, plus, found);
+        dirents->offsets.push_back(start);
+        if (!found) {
+            break;
+        }
+        dirents->data.resize(start + len);
+        add_dirent(req, dirents->data.data() + start, len, dir, pos, plus, found);
+    }
+    return dirents;
+}
+
+// Fill one readdir(plus) reply. Listings are served as slices of a
+// cached serialized buffer when possible, and built entry by entry
+// otherwise; either way a listing resumes exactly where the last buffer
+// filled up.
+void reply_dir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, bool plus) {
+    count_request(RequestCounters::get_instance().readdirs);
+    const DirectoryEntry* dir = ZipEntryManager::get_instance().dir_by_inode(ino);
+    if (!dir) {
+        fuse_reply_err(req, ENOTDIR);
+        return;
+    }
+
+    auto& cache = DirentCache::get_instance();
+    if (cache.cacheable(dir, plus)) {
+        DirentData dirents = cache.lookup(dir, plus);
+        if (!dirents) {
+            dirents = build_dirents(req, *dir, plus);
+            cache.insert(dir, plus, dirents);
+        }
+        auto range = dirents->slice(offset, size);
+        fuse_reply_buf(req, dirents->data.data() + range.first, range.second - range.first);
+        return;
+    }
+
+    std::unique_ptr<char[]> buf(new (std::nothrow) char[size]);
+    if (!buf) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+
+    size_t used = 0;
+    bool found;
+    for (size_t pos = offset; ; pos++) {
+        size_t len = add_dirent(req, buf.get() + used, size - used, *dir, pos, plus, found);
+        if (!found || len > size - used) {
+            break;      // Done, or did not fit; the next call starts with it
+        }
+        used += len;
+    }
+
+    fuse_reply_buf(req, buf.get(), used);
+}
+
+} // namespace
+
+void zipfs_ll_init(void *userdata, struct fuse_conn_info *conn) {
+    (void) userdata;
+    zipfs_configure_conn(conn);
+    std::cerr << "FUSE low-level filesystem initialized" << std::endl;
+}
+
+void zipfs_ll_destroy(void *userdata) {
+    (void) userdata;
+    std::cerr << "FUSE filesystem shutting down" << std::endl;
+}
+
+void zipfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    count_request(RequestCounters::get_instance().lookups);
+    const DirectoryEntry* dir = ZipEntryManager::get_instance().dir_by_inode(parent);
+    if (!dir) {
+        fuse_reply_err(req, ENOTDIR);
+        return;
+    }
+
+    const auto& options = MountConfig::get_instance();
+    struct fuse_entry_param e;
+    std::memset(&e, 0, sizeof(e));
+    if (const DirectoryEntry* child = dir->find_dir(name)) {
+        zipfs_stat_dir(*child, &e.attr);
+    } else if (const FileEntry* file = dir->find_file(name)) {
+        zipfs_stat_file(*file, &e.attr);
+    } else if (options.negative_timeout > 0) {
+        // Inode 0: the kernel keeps the miss for entry_timeout seconds
+        e.entry_timeout = options.negative_timeout;
+        fuse_reply_entry(req, &e);
+        return;
+    } else {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    e.ino = e.attr.st_ino;
+    e.attr_timeout = options.attr_timeout;
+    e.entry_timeout = options.entry_timeout;
+    fuse_reply_entry(req, &e);
+}
+
+void zipfs_ll_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup) {
+    // Index entries live for the whole mount: nothing to release
+    (void) ino;
+    (void) nlookup;
+    fuse_reply_none(req);
+}
+
+void zipfs_ll_forget_multi(fuse_req_t req, size_t count, struct fuse_forget_data *forgets) {
+    (void) count;
+    (void) forgets;
+    fuse_reply_none(req);
+}
+
+void zipfs_ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    (void) fi;
+
+    count_request(RequestCounters::get_instance().getattrs);
+    struct stat stbuf;
+    if (!stat_inode(ino, &stbuf)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    fuse_reply_attr(req, &stbuf, MountConfig::get_instance().attr_timeout);
+}
+
+void zipfs_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    auto& manager = ZipEntryManager::get_instance();
+
+    const FileEntry* file = manager.file_by_inode(ino);
+    if (!file) {
+        fuse_reply_err(req, manager.dir_by_inode(ino) ? EISDIR : ENOENT);
+        return;
+    }
+
+    // Only allow read-only access
+    if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+        fuse_reply_err(req, EACCES);
+        return;
+    }
+
+    FileHandle* fh = new (std::nothrow) FileHandle(file, &manager.archive(file->zip_path_idx()));
+    if (!fh) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+
+    int res = fh->open();
+    if (res < 0) {
+        delete fh;
+        fuse_reply_err(req, -res);
+        return;
+    }
+    fi->fh = reinterpret_cast<uint64_t>(fh);
+    fi->keep_cache = 1;
+
+    // An interrupted open gets no release
+    if (fuse_reply_open(req, fi) == -ENOENT) {
+        delete fh;
+    }
+}
+
+void zipfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset,
+                   struct fuse_file_info *fi) {
+    (void) ino;
+
+    struct fuse_bufvec bufv;
+    int res = zipfs_fill_bufvec(*reinterpret_cast<FileHandle*>(fi->fh), size, offset, bufv);
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+
+    fuse_reply_data(req, &bufv, FUSE_BUF_SPLICE_MOVE);
+    std::free(bufv.buf[0].mem);
+}
+
+void zipfs_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    (void) ino;
+    delete reinterpret_cast<FileHandle*>(fi->fh);
+    fi->fh = 0;
+    fuse_reply_err(req, 0);
+}
+
+void zipfs_ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    if (!ZipEntryManager::get_instance().dir_by_inode(ino)) {
+        fuse_reply_err(req, ENOTDIR);
+        return;
+    }
+    fuse_reply_open(req, fi);
+}
+
+void zipfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset,
+                      struct fuse_file_info *fi) {
+    (void) fi;
+    reply_dir(req, ino, size, offset, false);
+}
+
+void zipfs_ll_readdirplus(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset,
+                          struct fuse_file_info *fi) {
+    (void) fi;
+    reply_dir(req, ino, size, offset, true);
+}
+
+void zipfs_ll_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name, size_t size) {
+    if (ino != FUSE_ROOT_ID || std::strcmp(name, kStatsXattr) != 0) {
+        fuse_reply_err(req, ENODATA);
+        return;
+    }
+
+    std::string stats = format_stats();
+    if (size == 0) {
+        fuse_reply_xattr(req, stats.size());
+    } else if (size < stats.size()) {
+        fuse_reply_err(req, ERANGE);
+    } else {
+        fuse_reply_buf(req, stats.data(), stats.size());
+    }
+}
+
+void zipfs_ll_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
+    size_t len = ino == FUSE_ROOT_ID ? std::strlen(kStatsXattr) + 1 : 0;
+    if (size == 0) {
+        fuse_reply_xattr(req, len);
+    } else if (size < len) {
+        fuse_reply_err(req, ERANGE);
+    } else {
+        fuse_reply_buf(req, kStatsXattr, len);
+    }
+}
+
+struct fuse_lowlevel_ops* get_zipfs_lowlevel_operations() {
+    static struct fuse_lowlevel_ops ops = {};
+
+    ops.init = zipfs_ll_init;
+    ops.destroy = zipfs_ll_destroy;
+    ops.lookup = zipfs_ll_lookup;
+    ops.forget = zipfs_ll_forget;
+    ops.forget_multi = zipfs_ll_forget_multi;
+    ops.getattr = zipfs_ll_getattr;
+    ops.open = zipfs_ll_open;
+    ops.read = zipfs_ll_read;
+    ops.release = zipfs_ll_release;
+    ops.opendir = zipfs_ll_opendir;
+    ops.readdir = zipfs_ll_readdir;
+    ops.readdirplus = zipfs_ll_readdirplus;
+    ops.getxattr = zipfs_ll_getxattr;
+    ops.listxattr = zipfs_ll_listxattr;
+
+    return &ops;
+}
+
+int zipfs_lowlevel_main(struct fuse_args* args) {
+    struct fuse_cmdline_opts opts;
+    if (fuse_parse_cmdline(args, &opts) != 0) {
+        return 1;
+    }
+    // --help and --version print and exit, as they do under fuse_main()
+    if (opts.show_help || opts.show_version) {
+        if (opts.show_help) {
+            std::cout << "usage: " << args->argv[0] << " [options] <mountpoint>\n\n" << std::flush;
+            fuse_cmdline_help();
+            fuse_lowlevel_help();
+        } else {
+            std::cout << "FUSE library version " << fuse_pkgversion() << std::endl;
+            fuse_lowlevel_version();
+        }
+        std::free(opts.mountpoint);
+        return 0;
+    }
+    if (!opts.mountpoint) {
+        std::cerr << "Error: No mount point given\n";
+        return 1;
+    }
+
+    int ret = 1;
+    struct fuse_session* se = fuse_session_new(args, get_zipfs_lowlevel_operations(),
+                                               sizeof(struct fuse_lowlevel_ops), nullptr);
+    if (se) {
+        if (fuse_set_signal_handlers(se) == 0) {
+            if (fuse_session_mount(se, opts.mountpoint) == 0) {
+                fuse_daemonize(opts.foreground);
+                if (opts.singlethread) {
+                    ret = fuse_session_loop(se);
+                } else {
+                    ret = fuse_session_loop_mt(se, opts.clone_fd);
+                }
+                ret = ret ? 1 : 0;
+                fuse_session_unmount(se);
+            }
+            fuse_remove_signal_handlers(se);
+        }
+        fuse_session_destroy(se);
+    }
+
+    std::free(opts.mountpoint);
+    return ret;
+}
+
+} // namespace scalable_zip_fs
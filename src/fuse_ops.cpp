@@ -1,16 +1,23 @@
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <cerrno>
 #include <fcntl.h>
-#include <zip.h>
 #include <iostream>
+#include <memory>
+#include <new>
 
 #include "fuse_ops.hpp"
+#include "options.hpp"
+#include "prefetch.hpp"
+#include "reader.hpp"
+#include "stats.hpp"
 #include "zipent.hpp"
 
 namespace scalable_zip_fs {
 
-void* zipfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg) {
-    // Enable io_uring if available
+void zipfs_configure_conn(struct fuse_conn_info *conn) {
+    // Let the kernel keep several reads of a file in flight
     if (conn->capable & FUSE_CAP_ASYNC_READ) {
         conn->want |= FUSE_CAP_ASYNC_READ;
         std::cerr << "Enabled FUSE_CAP_ASYNC_READ" << std::endl;
@@ -21,6 +28,154 @@ void* zipfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg) {
         std::cerr << "Enabled FUSE_CAP_PARALLEL_DIROPS" << std::endl;
     }
 
+    // Send attributes with every listing instead of letting the kernel
+    // decide per directory: they cost nothing to produce, and a listing
+    // is usually followed by a stat() of every entry
+    if (conn->capable & FUSE_CAP_READDIRPLUS) {
+        conn->want |= FUSE_CAP_READDIRPLUS;
+        conn->want &= ~FUSE_CAP_READDIRPLUS_AUTO;
+        std::cerr << "Enabled FUSE_CAP_READDIRPLUS" << std::endl;
+    }
+
+    // Let read_buf replies be spliced from the archive fd into /dev/fuse
+    if (MountConfig::get_instance().splice) {
+        if (conn->capable & FUSE_CAP_SPLICE_WRITE) {
+            conn->want |= FUSE_CAP_SPLICE_WRITE;
+            std::cerr << "Enabled FUSE_CAP_SPLICE_WRITE" << std::endl;
+        }
+        if (conn->capable & FUSE_CAP_SPLICE_MOVE) {
+            conn->want |= FUSE_CAP_SPLICE_MOVE;
+            std::cerr << "Enabled FUSE_CAP_SPLICE_MOVE" << std::endl;
+        }
+    }
+
+    // Transfer sizes. libfuse derives max_pages from max_write, and the
+    // kernel caps reads at max_pages, so this is what allows requests
+    // beyond the 128 KiB default.
+    const auto& options = MountConfig::get_instance();
+    uint64_t max_request = (uint64_t)options.max_request_kb << 10;
+    uint64_t max_readahead = (uint64_t)options.max_readahead_kb << 10;
+    conn->max_write = max_request;
+    if (max_readahead > 0 && max_readahead < conn->max_readahead) {
+        conn->max_readahead = max_readahead;
+    }
+    conn->max_background = options.max_background;
+    conn->congestion_threshold = options.congestion_threshold > 0 ?
+        std::min(options.congestion_threshold, options.max_background) :
+        options.max_background * 3 / 4;
+    std::cerr << "Requested max_write=" << conn->max_write
+              << " max_readahead=" << conn->max_readahead
+              << " max_background=" << conn->max_background
+              << " congestion_threshold=" << conn->congestion_threshold << std::endl;
+}
+
+void zipfs_stat_dir(const DirectoryEntry& dir, struct stat *stbuf) {
+    memset(stbuf, 0, sizeof(struct stat));
+    stbuf->st_ino = ZipEntryManager::get_instance().inode(&dir);
+    stbuf->st_mode = S_IFDIR | 0555;
+    stbuf->st_nlink = 2;
+    stbuf->st_size = 4096;
+}
+
+void zipfs_stat_file(const FileEntry& file, struct stat *stbuf) {
+    memset(stbuf, 0, sizeof(struct stat));
+    stbuf->st_ino = ZipEntryManager::get_instance().inode(&file);
+    stbuf->st_mode = S_IFREG | 0444;
+    stbuf->st_nlink = 1;
+    stbuf->st_size = file.size();
+}
+
+bool zipfs_dirent_at(const DirectoryEntry& dir, size_t pos, const char*& name, struct stat *stbuf) {
+    if (pos == 0) {
+        name = ".";
+        zipfs_stat_dir(dir, stbuf);
+        return true;
+    }
+    if (pos == 1) {
+        name = "..";
+        zipfs_stat_dir(dir.parent() ? *dir.parent() : dir, stbuf);
+        return true;
+    }
+
+    pos -= 2;
+    auto dirs = dir.dirs();
+    if (pos < dirs.size()) {
+        name = dirs[pos].c_name();
+        zipfs_stat_dir(dirs[pos], stbuf);
+        return true;
+    }
+
+    pos -= dirs.size();
+    if (pos < dir.files().size()) {
+        const FileEntry& file = ZipEntryManager::get_instance().listed_file(dir, pos);
+        name = file.c_name();
+        zipfs_stat_file(file, stbuf);
+        return true;
+    }
+    return false;
+}
+
+int zipfs_fill_bufvec(FileHandle& fh, size_t size, off_t offset, struct fuse_bufvec& bufv) {
+    // Equivalent of FUSE_BUFVEC_INIT, which is a C compound literal
+    bufv.count = 1;
+    bufv.idx = 0;
+    bufv.off = 0;
+    struct fuse_buf& buf = bufv.buf[0];
+
+    const FileEntry* file = fh.entry();
+    if (offset >= (off_t)file->size()) {
+        size = 0;
+    } else if (offset + size > file->size()) {
+        size = file->size() - offset;
+    }
+
+    buf.size = size;
+    buf.flags = static_cast<fuse_buf_flags>(0);
+    buf.mem = nullptr;
+    buf.fd = -1;
+    buf.pos = 0;
+
+    // Stored entries: point libfuse at the archive fd so the data can be
+    // spliced to the FUSE device without passing through this process
+    if (fh.strategy() == ReadStrategy::PREAD && MountConfig::get_instance().splice) {
+        int res = fh.resolve();
+        if (res < 0) {
+            return res;
+        }
+        buf.flags = static_cast<fuse_buf_flags>(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+        buf.fd = fh.archive().fd();
+        buf.pos = fh.data_offset() + offset;
+        Prefetcher::get_instance().access(fh.archive(), buf.pos, size);
+        return 0;
+    }
+
+    // Everything else is produced into memory
+    void* mem = std::malloc(size ? size : 1);
+    if (!mem) {
+        return -ENOMEM;
+    }
+
+    int res = fh.read(static_cast<char*>(mem), size, offset);
+    if (res < 0) {
+        std::free(mem);
+        return res;
+    }
+
+    buf.mem = mem;
+    buf.size = res;
+    return 0;
+}
+
+void* zipfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg) {
+    zipfs_configure_conn(conn);
+
+    // The index never changes, so names, attributes and misses can stay
+    // in the kernel's caches for as long as the mount lives
+    const auto& options = MountConfig::get_instance();
+    cfg->entry_timeout = options.entry_timeout;
+    cfg->attr_timeout = options.attr_timeout;
+    cfg->negative_timeout = options.negative_timeout;
+
     cfg->kernel_cache = 1;
     cfg->use_ino = 1;
     cfg->nullpath_ok = 0;
@@ -40,56 +195,64 @@ void zipfs_destroy(void *private_data) {
 int zipfs_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
     (void) fi;
 
-    memset(stbuf, 0, sizeof(struct stat));
-
+    count_request(RequestCounters::get_instance().getattrs);
     auto& manager = ZipEntryManager::get_instance();
 
     // Check if it's a directory
     const DirectoryEntry* dir = manager.lookup_dir(path);
     if (dir) {
-        stbuf->st_mode = S_IFDIR | 0555;
-        stbuf->st_nlink = 2;
-        stbuf->st_size = 4096;
+        zipfs_stat_dir(*dir, stbuf);
         return 0;
     }
 
     // Check if it's a file
     const FileEntry* file = manager.lookup_file(path);
     if (file) {
-        stbuf->st_mode = S_IFREG | 0444;
-        stbuf->st_nlink = 1;
-        stbuf->st_size = file->size();
+        zipfs_stat_file(*file, stbuf);
         return 0;
     }
 
     return -ENOENT;
 }
 
-int zipfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
-                  off_t offset, struct fuse_file_info *fi,
-                  enum fuse_readdir_flags flags) {
-    (void) offset;
-    (void) fi;
-    (void) flags;
-
-    auto& manager = ZipEntryManager::get_instance();
-
-    const DirectoryEntry* dir = manager.lookup_dir(path);
+int zipfs_opendir(const char *path, struct fuse_file_info *fi) {
+    const DirectoryEntry* dir = ZipEntryManager::get_instance().lookup_dir(path);
     if (!dir) {
         return -ENOENT;
     }
 
-    filler(buf, ".", nullptr, 0, (fuse_fill_dir_flags)0);
-    filler(buf, "..", nullptr, 0, (fuse_fill_dir_flags)0);
+    // Keep the resolved directory for the readdir calls that follow
+    fi->fh = reinterpret_cast<uint64_t>(dir);
+    return 0;
+}
+
+int zipfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                  off_t offset, struct fuse_file_info *fi,
+                  enum fuse_readdir_flags flags) {
+    count_request(RequestCounters::get_instance().readdirs);
 
-    // Add subdirectories
-    for (const auto& entry : dir->dirs()) {
-        filler(buf, entry.first.c_str(), nullptr, 0, (fuse_fill_dir_flags)0);
+    const DirectoryEntry* dir = fi ? reinterpret_cast<const DirectoryEntry*>(fi->fh) : nullptr;
+    if (!dir) {
+        dir = ZipEntryManager::get_instance().lookup_dir(path);
+        if (!dir) {
+            return -ENOENT;
+        }
     }
 
-    // Add files
-    for (const auto& entry : dir->files()) {
-        filler(buf, entry.first.c_str(), nullptr, 0, (fuse_fill_dir_flags)0);
+    // Attributes come from the index at no cost. For READDIR_PLUS they
+    // go to the kernel with the names, so stat() after a listing does not
+    // come back here; otherwise they still provide d_type.
+    auto fill_flags = (flags & FUSE_READDIR_PLUS) ? FUSE_FILL_DIR_PLUS : (fuse_fill_dir_flags)0;
+
+    // Entries are passed with their position plus one as the offset, so
+    // libfuse pages through the listing and each call resumes where the
+    // last one's buffer filled up instead of starting over
+    const char* name;
+    struct stat st;
+    for (size_t pos = offset; zipfs_dirent_at(*dir, pos, name, &st); pos++) {
+        if (filler(buf, name, &st, pos + 1, fill_flags)) {
+            break;
+        }
     }
 
     return 0;
@@ -108,13 +271,29 @@ int zipfs_open(const char *path, struct fuse_file_info *fi) {
         return -EACCES;
     }
 
+    // Keep the resolved entry for subsequent reads
+    FileHandle* fh = new (std::nothrow) FileHandle(file, &manager.archive(file->zip_path_idx()));
+    if (!fh) {
+        return -ENOMEM;
+    }
+
+    int res = fh->open();
+    if (res < 0) {
+        delete fh;
+        return res;
+    }
+    fi->fh = reinterpret_cast<uint64_t>(fh);
+
     return 0;
 }
 
 int zipfs_read(const char *path, char *buf, size_t size, off_t offset,
                struct fuse_file_info *fi) {
-    (void) fi;
+    if (fi && fi->fh) {
+        return reinterpret_cast<FileHandle*>(fi->fh)->read(buf, size, offset);
+    }
 
+    // No handle from open(): resolve the path for this read only
     auto& manager = ZipEntryManager::get_instance();
 
     const FileEntry* file = manager.lookup_file(path);
@@ -122,70 +301,76 @@ int zipfs_read(const char *path, char *buf, size_t size, off_t offset,
         return -ENOENT;
     }
 
-    // Check bounds
-    if (offset >= (off_t)file->size()) {
-        return 0;
-    }
+    FileHandle fh(file, &manager.archive(file->zip_path_idx()));
+    return fh.read(buf, size, offset);
+}
 
-    // Adjust size if reading past end of file
-    if (offset + size > file->size()) {
-        size = file->size() - offset;
-    }
+int zipfs_read_buf(const char *path, struct fuse_bufvec **bufp, size_t size,
+                   off_t offset, struct fuse_file_info *fi) {
+    auto& manager = ZipEntryManager::get_instance();
 
-    // Open the ZIP file (will be cached by OS for uncompressed ZIPs)
-    const std::string& zip_path = manager.get_zip_path(file->zip_path_idx());
-    int err = 0;
-    zip_t* za = zip_open(zip_path.c_str(), ZIP_RDONLY, &err);
-
-    if (za == nullptr) {
-        std::cerr << "Failed to open ZIP file: " << zip_path << std::endl;
-        return -EIO;
-    }
-
-    // Open the file within the ZIP
-    zip_file_t* zf = zip_fopen_index(za, file->offset(), 0);
-    if (zf == nullptr) {
-        std::cerr << "Failed to open file in ZIP at index " << file->offset() << std::endl;
-        zip_close(za);
-        return -EIO;
-    }
-
-    // Seek to the offset if needed
-    if (offset > 0) {
-        // We need to read and discard bytes up to the offset
-        char discard_buf[4096];
-        off_t remaining = offset;
-        while (remaining > 0) {
-            size_t to_read = (remaining > 4096) ? 4096 : remaining;
-            zip_int64_t result = zip_fread(zf, discard_buf, to_read);
-            if (result < 0) {
-                zip_fclose(zf);
-                zip_close(za);
-                return -EIO;
-            }
-            remaining -= result;
-            if (result == 0) {
-                break;
-            }
+    FileHandle* fh = fi ? reinterpret_cast<FileHandle*>(fi->fh) : nullptr;
+    std::unique_ptr<FileHandle> tmp_fh;
+    if (!fh) {
+        // No handle from open(): resolve the path for this read only
+        const FileEntry* file = manager.lookup_file(path);
+        if (!file) {
+            return -ENOENT;
         }
+        tmp_fh = std::make_unique<FileHandle>(file, &manager.archive(file->zip_path_idx()));
+        fh = tmp_fh.get();
+    }
+
+    struct fuse_bufvec* bufv = static_cast<struct fuse_bufvec*>(std::malloc(sizeof(struct fuse_bufvec)));
+    if (!bufv) {
+        return -ENOMEM;
     }
+    // libfuse frees the bufvec and any memory buffer in it
+    int res = zipfs_fill_bufvec(*fh, size, offset, *bufv);
+    if (res < 0) {
+        std::free(bufv);
+        return res;
+    }
+    *bufp = bufv;
+    return 0;
+}
 
-    // Read the actual data
-    zip_int64_t bytes_read = zip_fread(zf, buf, size);
+int zipfs_getxattr(const char *path, const char *name, char *value, size_t size) {
+    if (std::strcmp(path, "/") != 0 || std::strcmp(name, kStatsXattr) != 0) {
+        return -ENODATA;
+    }
 
-    zip_fclose(zf);
-    zip_close(za);
+    std::string stats = format_stats();
+    if (size == 0) {
+        return stats.size();
+    }
+    if (size < stats.size()) {
+        return -ERANGE;
+    }
+    std::memcpy(value, stats.data(), stats.size());
+    return stats.size();
+}
 
-    if (bytes_read < 0) {
-        return -EIO;
+int zipfs_listxattr(const char *path, char *list, size_t size) {
+    if (std::strcmp(path, "/") != 0) {
+        return 0;
     }
 
-    return bytes_read;
+    size_t len = std::strlen(kStatsXattr) + 1;
+    if (size == 0) {
+        return len;
+    }
+    if (size < len) {
+        return -ERANGE;
+    }
+    std::memcpy(list, kStatsXattr, len);
+    return len;
 }
 
 int zipfs_release(const char *path, struct fuse_file_info *fi) {
     (void) path;
-    (void) fi;
+    delete reinterpret_cast<FileHandle*>(fi->fh);
+    fi->fh = 0;
     return 0;
 }
 
@@ -195,10 +380,14 @@ struct fuse_operations* get_zipfs_operations() {
     ops.init = zipfs_init;
     ops.destroy = zipfs_destroy;
     ops.getattr = zipfs_getattr;
+    ops.opendir = zipfs_opendir;
     ops.readdir = zipfs_readdir;
     ops.open = zipfs_open;
     ops.read = zipfs_read;
+    ops.read_buf = zipfs_read_buf;
     ops.release = zipfs_release;
+    ops.getxattr = zipfs_getxattr;
+    ops.listxattr = zipfs_listxattr;
 
     return &ops;
 }
@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "inflate.hpp"
+
+namespace scalable_zip_fs {
+
+namespace {
+
+constexpr size_t kInputChunk = 64 * 1024;
+
+} // namespace
+
+InflateStream::InflateStream(const FileEntry* entry, Archive* archive, uint64_t data_offset)
+    : entry_(entry), archive_(archive), data_offset_(data_offset), initialized_(false), finished_(false),
+      out_(0), in_read_(0), input_(kInputChunk), window_(kInflateWindowSize), window_pos_(0),
+      checkpoint_next_(UINT64_MAX), checkpoint_span_(0) {
+    std::memset(&strm_, 0, sizeof(strm_));
+}
+
+InflateStream::~InflateStream() {
+    if (initialized_) {
+        inflateEnd(&strm_);
+    }
+}
+
+int InflateStream::reset(const InflateCheckpoint* cp) {
+    if (!initialized_) {
+        // Negative window bits: raw deflate data without a zlib header
+        if (inflateInit2(&strm_, -15) != Z_OK) {
+            return -ENOMEM;
+        }
+        initialized_ = true;
+    } else if (inflateReset(&strm_) != Z_OK) {
+        return -EIO;
+    }
+
+    strm_.next_in = nullptr;
+    strm_.avail_in = 0;
+    finished_ = false;
+
+    if (!cp) {
+        out_ = 0;
+        in_read_ = 0;
+        window_pos_ = 0;
+        return 0;
+    }
+
+    out_ = cp->out;
+    in_read_ = cp->in;
+
+    // The checkpoint may sit in the middle of a byte
+    if (cp->bits) {
+        unsigned char byte;
+        if (archive_->pread(&byte, 1, data_offset_ + cp->in - 1) != 1) {
+            return -EIO;
+        }
+        inflatePrime(&strm_, cp->bits, byte >> (8 - cp->bits));
+    }
+    if (cp->window_size > 0 &&
+        inflateSetDictionary(&strm_, cp->window, cp->window_size) != Z_OK) {
+        return -EIO;
+    }
+
+    std::memcpy(window_.data(), cp->window, cp->window_size);
+    window_pos_ = cp->window_size % kInflateWindowSize;
+    return 0;
+}
+
+void InflateStream::record_checkpoints(uint64_t next_at, uint64_t span, CheckpointFn fn) {
+    checkpoint_next_ = next_at;
+    checkpoint_span_ = span;
+    on_checkpoint_ = std::move(fn);
+}
+
+int InflateStream::fill_input() {
+    uint64_t remaining = entry_->compressed_size() - in_read_;
+    if (remaining == 0) {
+        return 0;
+    }
+
+    size_t len = std::min<uint64_t>(input_.size(), remaining);
+    ssize_t n = archive_->pread(input_.data(), len, data_offset_ + in_read_);
+    if (n <= 0) {
+        return n < 0 ? n : -EIO;
+    }
+
+    in_read_ += n;
+    strm_.next_in = input_.data();
+    strm_.avail_in = n;
+    return n;
+}
+
+std::shared_ptr<InflateCheckpoint> InflateStream::make_checkpoint() const {
+    auto cp = std::make_shared<InflateCheckpoint>();
+    cp->out = out_;
+    cp->in = in_read_ - strm_.avail_in;
+    cp->bits = strm_.data_type & 7;
+
+    // Unroll the circular window, oldest byte first
+    if (out_ >= kInflateWindowSize) {
+        size_t tail = kInflateWindowSize - window_pos_;
+        std::memcpy(cp->window, window_.data() + window_pos_, tail);
+        std::memcpy(cp->window + tail, window_.data(), window_pos_);
+        cp->window_size = kInflateWindowSize;
+    } else {
+        std::memcpy(cp->window, window_.data(), out_);
+        cp->window_size = out_;
+    }
+    return cp;
+}
+
+ssize_t InflateStream::read(char* buf, size_t size, uint64_t offset) {
+    if (!initialized_) {
+        int res = reset(nullptr);
+        if (res < 0) {
+            return res;
+        }
+    }
+    if (offset < out_) {
+        return -EINVAL;
+    }
+
+    uint64_t end = offset + size;
+    while (!finished_ && out_ < end) {
+        // Out of input is not an error yet: inflate may still have output
+        // pending; a truncated entry shows up as no progress below
+        if (strm_.avail_in == 0) {
+            int res = fill_input();
+            if (res < 0) {
+                return res;
+            }
+        }
+
+        // Decode into the window; never past the end of the request, so the
+        // stream stops exactly at `end`
+        unsigned char* out_ptr = window_.data() + window_pos_;
+        size_t avail = std::min<uint64_t>(kInflateWindowSize - window_pos_, end - out_);
+        unsigned avail_in_before = strm_.avail_in;
+        strm_.next_out = out_ptr;
+        strm_.avail_out = avail;
+
+        int ret = inflate(&strm_, Z_BLOCK);
+        if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR) {
+            return -EIO;
+        }
+
+        size_t produced = avail - strm_.avail_out;
+        if (produced == 0 && strm_.avail_in == avail_in_before && ret != Z_STREAM_END) {
+            return -EIO;    // No progress possible
+        }
+
+        // Copy the part of this chunk that falls inside the request
+        uint64_t lo = std::max(out_, offset);
+        uint64_t hi = out_ + produced;
+        if (lo < hi) {
+            std::memcpy(buf + (lo - offset), out_ptr + (lo - out_), hi - lo);
+        }
+
+        out_ += produced;
+        window_pos_ = (window_pos_ + produced) % kInflateWindowSize;
+
+        if (ret == Z_STREAM_END) {
+            finished_ = true;
+            break;
+        }
+
+        // Bit 7: stopped at a block boundary; bit 6: that was the last block
+        if (on_checkpoint_ && (strm_.data_type & 128) && !(strm_.data_type & 64) &&
+            out_ >= checkpoint_next_) {
+            on_checkpoint_(make_checkpoint());
+            checkpoint_next_ = out_ + checkpoint_span_;
+        }
+    }
+
+    return out_ > offset ? std::min(out_, end) - offset : 0;
+}
+
+InflateIndexImpl::InflateIndexImpl()
+    : span_(1024 * 1024), budget_(256 * 1024 * 1024), used_(0) { }
+
+void InflateIndexImpl::configure(size_t span, size_t budget) {
+    span_ = span;
+    budget_ = budget;
+}
+
+std::shared_ptr<InflateIndexImpl::EntryIndex> InflateIndexImpl::get_index(const FileEntry* entry, bool create) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = indexes_.find(entry);
+    if (it != indexes_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->second;
+    }
+    if (!create) {
+        return nullptr;
+    }
+
+    lru_.emplace_front(entry, std::make_shared<EntryIndex>());
+    indexes_.emplace(entry, lru_.begin());
+    return lru_.front().second;
+}
+
+std::shared_ptr<const InflateCheckpoint> InflateIndexImpl::find(const FileEntry* entry, uint64_t offset,
+                                                                uint64_t& frontier) {
+    frontier = 0;
+
+    // Entries within one span never need a checkpoint
+    if (entry->size() <= span_) {
+        return nullptr;
+    }
+
+    auto index = get_index(entry, true);
+    std::lock_guard<std::mutex> lock(index->mutex);
+
+    auto& points = index->points;
+    if (!points.empty()) {
+        frontier = points.back()->out;
+    }
+
+    auto it = std::upper_bound(points.begin(), points.end(), offset,
+        [](uint64_t off, const std::shared_ptr<const InflateCheckpoint>& cp) { return off < cp->out; });
+    if (it == points.begin()) {
+        return nullptr;
+    }
+    return *std::prev(it);
+}
+
+void InflateIndexImpl::add(const FileEntry* entry, std::shared_ptr<const InflateCheckpoint> cp) {
+    auto index = get_index(entry, false);
+    if (!index) {
+        return;
+    }
+
+    const size_t cost = sizeof(InflateCheckpoint);
+    {
+        std::lock_guard<std::mutex> lock(index->mutex);
+        // A single entry may use the whole budget but no more
+        if (index->evicted || index->bytes + cost > budget_) {
+            return;
+        }
+
+        auto& points = index->points;
+        auto it = std::lower_bound(points.begin(), points.end(), cp->out,
+            [](const std::shared_ptr<const InflateCheckpoint>& p, uint64_t off) { return p->out < off; });
+        if (it != points.end() && (*it)->out == cp->out) {
+            return;     // Another reader got there first
+        }
+        points.insert(it, std::move(cp));
+        index->bytes += cost;
+    }
+
+    // The entry lock is released first; evict() takes locks in the
+    // opposite order
+    if (used_.fetch_add(cost, std::memory_order_relaxed) + cost > budget_) {
+        evict();
+    }
+}
+
+void InflateIndexImpl::evict() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Keep the most recently used index even if it alone is over budget
+    while (used_.load(std::memory_order_relaxed) > budget_ && lru_.size() > 1) {
+        auto& victim = lru_.back();
+        {
+            std::lock_guard<std::mutex> index_lock(victim.second->mutex);
+            victim.second->evicted = true;
+            victim.second->points.clear();
+            used_.fetch_sub(victim.second->bytes, std::memory_order_relaxed);
+            victim.second->bytes = 0;
+        }
+        indexes_.erase(victim.first);
+        lru_.pop_back();
+    }
+}
+
+int InflateIndexImpl::seek(InflateStream& stream, const FileEntry* entry, uint64_t offset) {
+    uint64_t frontier = 0;
+    auto cp = find(entry, offset, frontier);
+
+    int res = stream.reset(cp.get());
+    if (res < 0) {
+        return res;
+    }
+
+    // Only extend the index past what is already known
+    if (entry->size() > span_) {
+        stream.record_checkpoints(frontier + span_, span_,
+            [this, entry](std::shared_ptr<const InflateCheckpoint> point) { add(entry, std::move(point)); });
+    }
+    return 0;
+}
+
+ssize_t InflateIndexImpl::read(const FileEntry* entry, Archive& archive, uint64_t data_offset,
+                               char* buf, size_t size, off_t offset) {
+    InflateStream stream(entry, &archive, data_offset);
+    int res = seek(stream, entry, offset);
+    if (res < 0) {
+        return res;
+    }
+    return stream.read(buf, size, offset);
+}
+
+} // namespace scalable_zip_fs
@@ -1,11 +1,20 @@
 #include <iostream>
 #include <vector>
 #include <filesystem>
+#include <algorithm>
 #include <cstring>
+#include <thread>
 
 #include "zipfs.hpp"
 #include "zipent.hpp"
 #include "fuse_ops.hpp"
+#include "fuse_lowlevel_ops.hpp"
+#include "buffer_pool.hpp"
+#include "dirent_cache.hpp"
+#include "entry_cache.hpp"
+#include "inflate.hpp"
+#include "options.hpp"
+#include "prefetch.hpp"
 
 void print_usage(const char* prog_name) {
     std::cerr << "Usage: " << prog_name << " <zip_file1> [zip_file2 ...] <mount_point> [FUSE options]\n";
@@ -22,6 +31,8 @@ void print_usage(const char* prog_name) {
     std::cerr << "  -s                          Single-threaded mode\n";
     std::cerr << "  -o option[,option...]       Mount options\n";
     std::cerr << "\n";
+    scalable_zip_fs::print_mount_options_help();
+    std::cerr << "\n";
     std::cerr << "Example:\n";
     std::cerr << "  " << prog_name << " archive.zip /mnt/zipfs -f\n";
     std::cerr << "  " << prog_name << " first.zip second.zip /mnt/zipfs -o ro\n";
@@ -48,6 +59,11 @@ int main(int argc, char **argv) {
             // This is a FUSE option
             fuse_args.push_back(argv[i]);
             parsing_files = false;
+
+            // "-o" takes the next argument as its value
+            if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+                fuse_args.push_back(argv[++i]);
+            }
         } else {
             if (parsing_files) {
                 // Collect potential ZIP files
@@ -81,6 +97,14 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    // Pull our own -o options out before handing the rest to FUSE
+    struct fuse_args args = FUSE_ARGS_INIT((int)fuse_args.size(), fuse_args.data());
+    auto& options = scalable_zip_fs::MountConfig::get_instance();
+    if (!scalable_zip_fs::parse_mount_options(&args, options)) {
+        fuse_opt_free_args(&args);
+        return 1;
+    }
+
     // Validate and index all ZIP files
     std::cerr << "Indexing ZIP files...\n";
     auto& manager = scalable_zip_fs::ZipEntryManager::get_instance();
@@ -88,43 +112,109 @@ int main(int argc, char **argv) {
     for (const auto& zip_file : zip_files) {
         if (!std::filesystem::exists(zip_file)) {
             std::cerr << "Error: ZIP file '" << zip_file << "' does not exist\n";
+            fuse_opt_free_args(&args);
             return 1;
         }
 
         if (!std::filesystem::is_regular_file(zip_file)) {
             std::cerr << "Error: '" << zip_file << "' is not a regular file\n";
+            fuse_opt_free_args(&args);
             return 1;
         }
+    }
+
+    // Indexing waits on storage more than on the CPU, so use more threads
+    // than cores by default
+    unsigned index_threads = options.index_threads;
+    if (index_threads == 0) {
+        index_threads = std::max(16u, std::thread::hardware_concurrency());
+    }
+
+    if (!options.index_cache.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(options.index_cache, ec);
+        if (ec) {
+            std::cerr << "Warning: Cannot use index cache '" << options.index_cache << "': "
+                      << ec.message() << "\n";
+        } else {
+            manager.set_index_cache(std::filesystem::absolute(options.index_cache));
+        }
+    }
 
-        std::cerr << "  Indexing: " << zip_file << "\n";
-        try {
-            manager.index_zipfile(zip_file);
-        } catch (const std::exception& e) {
-            std::cerr << "Error indexing ZIP file: " << e.what() << std::endl;
-            return 1;
+    manager.set_listing_by_offset(options.readdir_order == scalable_zip_fs::ListingOrder::OFFSET);
+
+    try {
+        manager.index_zipfiles(std::vector<std::filesystem::path>(zip_files.begin(), zip_files.end()),
+                               index_threads);
+    } catch (const std::exception& e) {
+        std::cerr << "Error indexing ZIP file: " << e.what() << std::endl;
+        fuse_opt_free_args(&args);
+        return 1;
+    }
+
+    scalable_zip_fs::InflateIndex::get_instance().configure(
+        (size_t)options.inflate_span_mb << 20, (size_t)options.inflate_index_mb << 20);
+    if (!options.no_cache) {
+        scalable_zip_fs::EntryCache::get_instance().configure(
+            (size_t)options.cache_mb << 20, (size_t)options.cache_max_entry_kb << 10);
+    }
+    scalable_zip_fs::Prefetcher::get_instance().configure(
+        manager.num_archives(), (size_t)options.prefetch_kb << 10);
+    if (options.lowlevel) {
+        scalable_zip_fs::DirentCache::get_instance().configure((size_t)options.dirent_cache_mb << 20);
+    }
+
+    if (options.read_mode == scalable_zip_fs::ReadMode::MMAP) {
+        size_t mapped = 0;
+        for (size_t i = 0; i < manager.num_archives(); i++) {
+            if (manager.archive(i).map(options.populate, options.madvise)) {
+                mapped++;
+            }
         }
+        std::cerr << "Mapped " << mapped << " of " << manager.num_archives() << " archives\n";
+    }
+
+    if (options.read_mode == scalable_zip_fs::ReadMode::DIRECT) {
+        size_t opened = 0;
+        size_t alignment = 512;
+        for (size_t i = 0; i < manager.num_archives(); i++) {
+            auto& archive = manager.archive(i);
+            if (archive.open_direct(options.direct_align)) {
+                alignment = std::max(alignment, archive.direct_alignment());
+                opened++;
+            }
+        }
+        // Room for the largest request plus the partial blocks at both ends
+        scalable_zip_fs::BufferPool::get_instance().configure(
+            alignment, ((size_t)options.max_request_kb << 10) + 2 * alignment);
+        std::cerr << "Opened " << opened << " of " << manager.num_archives()
+                  << " archives with O_DIRECT (alignment " << alignment << ")\n";
     }
 
     std::cerr << "Indexing complete. Mounting filesystem at " << mount_point << "\n";
 
     // Add mount point to FUSE args
-    fuse_args.push_back(const_cast<char*>(mount_point.c_str()));
+    fuse_opt_add_arg(&args, mount_point.c_str());
 
     // Enable read-only and default permissions
-    fuse_args.push_back(const_cast<char*>("-o"));
-    fuse_args.push_back(const_cast<char*>("ro,default_permissions"));
+    fuse_opt_add_arg(&args, "-o");
+    fuse_opt_add_arg(&args, "ro,default_permissions");
 
     std::cerr << "\nStarting FUSE with arguments: ";
-    for (const auto& arg : fuse_args) {
-        std::cerr << arg << " ";
+    for (int i = 0; i < args.argc; i++) {
+        std::cerr << args.argv[i] << " ";
     }
     std::cerr << "\n" << std::endl;
 
     // Start FUSE
-    int fuse_argc = fuse_args.size();
-    struct fuse_operations* ops = scalable_zip_fs::get_zipfs_operations();
-
-    int ret = fuse_main(fuse_argc, fuse_args.data(), ops, nullptr);
+    int ret;
+    if (options.lowlevel) {
+        ret = scalable_zip_fs::zipfs_lowlevel_main(&args);
+    } else {
+        struct fuse_operations* ops = scalable_zip_fs::get_zipfs_operations();
+        ret = fuse_main(args.argc, args.argv, ops, nullptr);
+    }
 
+    fuse_opt_free_args(&args);
     return ret;
 }
@@ -0,0 +1,281 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "options.hpp"
+
+namespace scalable_zip_fs {
+
+namespace {
+
+enum {
+    KEY_READ_MODE,
+    KEY_MADVISE,
+    KEY_POPULATE,
+    KEY_SPLICE,
+    KEY_NO_SPLICE,
+    KEY_DIRECT_ALIGN,
+    KEY_INFLATE_SPAN,
+    KEY_INFLATE_INDEX,
+    KEY_CACHE_MB,
+    KEY_CACHE_MAX_ENTRY,
+    KEY_NO_CACHE,
+    KEY_PREFETCH,
+    KEY_MAX_REQUEST,
+    KEY_MAX_READAHEAD,
+    KEY_MAX_BACKGROUND,
+    KEY_CONGESTION,
+    KEY_INDEX_THREADS,
+    KEY_INDEX_CACHE,
+    KEY_LOWLEVEL,
+    KEY_ENTRY_TIMEOUT,
+    KEY_ATTR_TIMEOUT,
+    KEY_NEGATIVE_TIMEOUT,
+    KEY_DIRENT_CACHE,
+    KEY_READDIR_ORDER,
+};
+
+const struct fuse_opt option_spec[] = {
+    FUSE_OPT_KEY("read_mode=%s", KEY_READ_MODE),
+    FUSE_OPT_KEY("madvise=%s", KEY_MADVISE),
+    FUSE_OPT_KEY("populate", KEY_POPULATE),
+    FUSE_OPT_KEY("splice", KEY_SPLICE),
+    FUSE_OPT_KEY("no_splice", KEY_NO_SPLICE),
+    FUSE_OPT_KEY("direct_align=%s", KEY_DIRECT_ALIGN),
+    FUSE_OPT_KEY("inflate_span_mb=%s", KEY_INFLATE_SPAN),
+    FUSE_OPT_KEY("inflate_index_mb=%s", KEY_INFLATE_INDEX),
+    FUSE_OPT_KEY("cache_mb=%s", KEY_CACHE_MB),
+    FUSE_OPT_KEY("cache_max_entry_kb=%s", KEY_CACHE_MAX_ENTRY),
+    FUSE_OPT_KEY("no_cache", KEY_NO_CACHE),
+    FUSE_OPT_KEY("prefetch_kb=%s", KEY_PREFETCH),
+    FUSE_OPT_KEY("max_request_kb=%s", KEY_MAX_REQUEST),
+    FUSE_OPT_KEY("max_readahead_kb=%s", KEY_MAX_READAHEAD),
+    FUSE_OPT_KEY("max_background=%s", KEY_MAX_BACKGROUND),
+    FUSE_OPT_KEY("congestion_threshold=%s", KEY_CONGESTION),
+    FUSE_OPT_KEY("index_threads=%s", KEY_INDEX_THREADS),
+    FUSE_OPT_KEY("index_cache=%s", KEY_INDEX_CACHE),
+    FUSE_OPT_KEY("lowlevel", KEY_LOWLEVEL),
+    FUSE_OPT_KEY("entry_timeout=%s", KEY_ENTRY_TIMEOUT),
+    FUSE_OPT_KEY("attr_timeout=%s", KEY_ATTR_TIMEOUT),
+    FUSE_OPT_KEY("negative_timeout=%s", KEY_NEGATIVE_TIMEOUT),
+    FUSE_OPT_KEY("dirent_cache_mb=%s", KEY_DIRENT_CACHE),
+    FUSE_OPT_KEY("readdir_order=%s", KEY_READDIR_ORDER),
+    FUSE_OPT_END
+};
+
+struct ParseState {
+    MountOptions* opts;
+    bool ok;
+};
+
+bool parse_read_mode(const char* value, ReadMode& mode) {
+    if (std::strcmp(value, "pread") == 0) {
+        mode = ReadMode::PREAD;
+    } else if (std::strcmp(value, "mmap") == 0) {
+        mode = ReadMode::MMAP;
+    } else if (std::strcmp(value, "direct") == 0) {
+        mode = ReadMode::DIRECT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_madvise(const char* value, MadvisePolicy& policy) {
+    if (std::strcmp(value, "normal") == 0) {
+        policy = MadvisePolicy::NORMAL;
+    } else if (std::strcmp(value, "random") == 0) {
+        policy = MadvisePolicy::RANDOM;
+    } else if (std::strcmp(value, "sequential") == 0) {
+        policy = MadvisePolicy::SEQUENTIAL;
+    } else if (std::strcmp(value, "willneed") == 0) {
+        policy = MadvisePolicy::WILLNEED;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_listing_order(const char* value, ListingOrder& order) {
+    if (std::strcmp(value, "name") == 0) {
+        order = ListingOrder::NAME;
+    } else if (std::strcmp(value, "offset") == 0) {
+        order = ListingOrder::OFFSET;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_unsigned(const char* value, unsigned& out, bool allow_zero = false) {
+    char* end = nullptr;
+    unsigned long v = std::strtoul(value, &end, 0);
+    if (*value == '\0' || *end != '\0' || (v == 0 && !allow_zero) || v > 0xFFFFFFFFul) {
+        return false;
+    }
+    out = static_cast<unsigned>(v);
+    return true;
+}
+
+bool parse_seconds(const char* value, double& out) {
+    char* end = nullptr;
+    double v = std::strtod(value, &end);
+    if (*value == '\0' || *end != '\0' || !(v >= 0 && v <= kForeverTimeout)) {
+        return false;
+    }
+    out = v;
+    return true;
+}
+
+int option_proc(void* data, const char* arg, int key, struct fuse_args* outargs) {
+    (void) outargs;
+    auto* state = static_cast<ParseState*>(data);
+    auto& opts = *state->opts;
+
+    const char* eq = std::strchr(arg, '=');
+    const char* value = eq ? eq + 1 : "";
+    bool valid = true;
+
+    switch (key) {
+    case KEY_READ_MODE:
+        valid = parse_read_mode(value, opts.read_mode);
+        break;
+    case KEY_MADVISE:
+        valid = parse_madvise(value, opts.madvise);
+        break;
+    case KEY_POPULATE:
+        opts.populate = true;
+        break;
+    case KEY_SPLICE:
+        opts.splice = true;
+        break;
+    case KEY_NO_SPLICE:
+        opts.splice = false;
+        break;
+    case KEY_DIRECT_ALIGN:
+        valid = parse_unsigned(value, opts.direct_align) &&
+                (opts.direct_align & (opts.direct_align - 1)) == 0;
+        break;
+    case KEY_INFLATE_SPAN:
+        valid = parse_unsigned(value, opts.inflate_span_mb);
+        break;
+    case KEY_INFLATE_INDEX:
+        valid = parse_unsigned(value, opts.inflate_index_mb);
+        break;
+    case KEY_CACHE_MB:
+        valid = parse_unsigned(value, opts.cache_mb);
+        break;
+    case KEY_CACHE_MAX_ENTRY:
+        valid = parse_unsigned(value, opts.cache_max_entry_kb);
+        break;
+    case KEY_NO_CACHE:
+        opts.no_cache = true;
+        break;
+    case KEY_PREFETCH:
+        valid = parse_unsigned(value, opts.prefetch_kb, true);
+        break;
+    case KEY_MAX_REQUEST:
+        valid = parse_unsigned(value, opts.max_request_kb) && opts.max_request_kb >= 4 &&
+                opts.max_request_kb <= kMaxRequestKb;
+        break;
+    case KEY_MAX_READAHEAD:
+        valid = parse_unsigned(value, opts.max_readahead_kb) && opts.max_readahead_kb <= kMaxRequestKb;
+        break;
+    case KEY_MAX_BACKGROUND:
+        valid = parse_unsigned(value, opts.max_background);
+        break;
+    case KEY_CONGESTION:
+        valid = parse_unsigned(value, opts.congestion_threshold);
+        break;
+    case KEY_INDEX_THREADS:
+        valid = parse_unsigned(value, opts.index_threads);
+        break;
+    case KEY_INDEX_CACHE:
+        opts.index_cache = value;
+        valid = !opts.index_cache.empty();
+        break;
+    case KEY_LOWLEVEL:
+        opts.lowlevel = true;
+        break;
+    case KEY_ENTRY_TIMEOUT:
+        valid = parse_seconds(value, opts.entry_timeout);
+        break;
+    case KEY_ATTR_TIMEOUT:
+        valid = parse_seconds(value, opts.attr_timeout);
+        break;
+    case KEY_NEGATIVE_TIMEOUT:
+        valid = parse_seconds(value, opts.negative_timeout);
+        break;
+    case KEY_DIRENT_CACHE:
+        valid = parse_unsigned(value, opts.dirent_cache_mb, true);
+        break;
+    case KEY_READDIR_ORDER:
+        valid = parse_listing_order(value, opts.readdir_order);
+        break;
+    default:
+        // Not ours: keep it for FUSE
+        return 1;
+    }
+
+    if (!valid) {
+        std::cerr << "Error: Invalid mount option '" << arg << "'\n";
+        state->ok = false;
+    }
+    return 0;
+}
+
+} // namespace
+
+bool parse_mount_options(struct fuse_args* args, MountOptions& opts) {
+    ParseState state{&opts, true};
+    if (fuse_opt_parse(args, &state, option_spec, option_proc) != 0) {
+        return false;
+    }
+    return state.ok;
+}
+
+void print_mount_options_help() {
+    std::cerr << "Filesystem options:\n";
+    std::cerr << "  -o read_mode=MODE           pread|mmap|direct: how stored entries are read\n";
+    std::cerr << "                              (default: pread)\n";
+    std::cerr << "  -o madvise=POLICY           normal|random|sequential|willneed hint for\n";
+    std::cerr << "                              archive mappings (read_mode=mmap)\n";
+    std::cerr << "  -o populate                 Prefault archive mappings (MAP_POPULATE)\n";
+    std::cerr << "  -o direct_align=N           O_DIRECT alignment in bytes (read_mode=direct;\n";
+    std::cerr << "                              default: queried from the filesystem)\n";
+    std::cerr << "  -o no_splice                Copy stored entries through a user buffer\n";
+    std::cerr << "                              instead of splicing from the archive fd\n";
+    std::cerr << "  -o inflate_span_mb=N        Checkpoint spacing for random access into\n";
+    std::cerr << "                              deflated entries (default: 1)\n";
+    std::cerr << "  -o inflate_index_mb=N       Memory budget for deflate checkpoints\n";
+    std::cerr << "                              (default: 256)\n";
+    std::cerr << "  -o cache_mb=N               Memory budget for decompressed small entries\n";
+    std::cerr << "                              (default: 256)\n";
+    std::cerr << "  -o cache_max_entry_kb=N     Largest entry kept decompressed (default: 1024)\n";
+    std::cerr << "  -o no_cache                 Disable the decompressed entry cache\n";
+    std::cerr << "  -o prefetch_kb=N            Largest readahead window across entries, 0 to\n";
+    std::cerr << "                              disable (default: 8192)\n";
+    std::cerr << "  -o max_request_kb=N         Largest FUSE read request, 4 to 1024 (default: 1024)\n";
+    std::cerr << "  -o max_readahead_kb=N       Kernel readahead per file, up to 1024\n";
+    std::cerr << "                              (default: kernel maximum)\n";
+    std::cerr << "  -o max_background=N         Outstanding background requests (default: 64)\n";
+    std::cerr << "  -o congestion_threshold=N   Background requests before the kernel throttles\n";
+    std::cerr << "                              readahead (default: 3/4 of max_background)\n";
+    std::cerr << "  -o index_threads=N          Archives parsed in parallel at startup\n";
+    std::cerr << "                              (default: max(16, cores))\n";
+    std::cerr << "  -o index_cache=DIR          Keep index snapshots in DIR for faster remounts\n";
+    std::cerr << "  -o lowlevel                 Use the inode based FUSE API instead of paths\n";
+    std::cerr << "  -o entry_timeout=S          Seconds the kernel may cache names\n";
+    std::cerr << "                              (default: forever, the index never changes)\n";
+    std::cerr << "  -o attr_timeout=S           Seconds the kernel may cache attributes\n";
+    std::cerr << "                              (default: forever)\n";
+    std::cerr << "  -o negative_timeout=S       Seconds the kernel may cache failed lookups,\n";
+    std::cerr << "                              0 to disable (default: forever)\n";
+    std::cerr << "  -o dirent_cache_mb=N        Memory budget for prebuilt directory listings\n";
+    std::cerr << "                              (lowlevel only), 0 to disable (default: 64)\n";
+    std::cerr << "  -o readdir_order=ORDER      name|offset: list files by name or in the order\n";
+    std::cerr << "                              their data is stored (default: name)\n";
+}
+
+} // namespace scalable_zip_fs
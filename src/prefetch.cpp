@@ -0,0 +1,79 @@
+#include <fcntl.h>
+#include <algorithm>
+
+#include "prefetch.hpp"
+
+namespace scalable_zip_fs {
+
+namespace {
+
+// Accesses this far behind or ahead of the stream still count as
+// sequential; parallel FUSE workers deliver neighbouring requests slightly
+// out of order, and local headers sit between entries
+constexpr uint64_t kBehindSlack = 1024 * 1024;
+constexpr uint64_t kAheadGap = 256 * 1024;
+
+// Sequential accesses needed before the first prefetch
+constexpr unsigned kMinHits = 2;
+
+constexpr size_t kInitialWindow = 128 * 1024;
+
+} // namespace
+
+PrefetcherImpl::PrefetcherImpl()
+    : num_archives_(0), max_window_(0), issued_bytes_(0), resets_(0) { }
+
+void PrefetcherImpl::configure(size_t num_archives, size_t max_window) {
+    num_archives_ = num_archives;
+    max_window_ = max_window;
+    streams_.reset(max_window > 0 ? new Stream[num_archives] : nullptr);
+}
+
+void PrefetcherImpl::access(const Archive& archive, uint64_t offset, uint64_t len) {
+    if (!enabled() || archive.id() >= num_archives_ || archive.direct()) {
+        return;
+    }
+
+    // Prefetching is only a hint: skip it rather than wait for another worker
+    Stream& stream = streams_[archive.id()];
+    std::unique_lock<std::mutex> lock(stream.mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+
+    uint64_t end = offset + len;
+    bool sequential = stream.pos > 0 &&
+        offset + kBehindSlack >= stream.pos && offset <= stream.pos + kAheadGap;
+
+    if (!sequential) {
+        if (stream.window > 0) {
+            resets_.fetch_add(1, std::memory_order_relaxed);
+        }
+        stream.pos = end;
+        stream.issued = 0;
+        stream.window = 0;
+        stream.hits = 0;
+        return;
+    }
+
+    stream.pos = std::max(stream.pos, end);
+    if (++stream.hits < kMinHits) {
+        return;
+    }
+    stream.window = std::min(stream.window == 0 ? kInitialWindow : stream.window * 2, max_window_);
+
+    // Top up once at least half a window has been consumed
+    uint64_t target = std::min<uint64_t>(stream.pos + stream.window, archive.size());
+    uint64_t start = std::max(stream.issued, stream.pos);
+    if (target <= start || (stream.issued > stream.pos && target - start < stream.window / 2)) {
+        return;
+    }
+    stream.issued = target;
+    lock.unlock();
+
+    if (posix_fadvise(archive.fd(), start, target - start, POSIX_FADV_WILLNEED) == 0) {
+        issued_bytes_.fetch_add(target - start, std::memory_order_relaxed);
+    }
+}
+
+} // namespace scalable_zip_fs
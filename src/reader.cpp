@@ -0,0 +1,277 @@
+#include <zip.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include "inflate.hpp"
+#include "prefetch.hpp"
+#include "reader.hpp"
+
+namespace scalable_zip_fs {
+
+namespace {
+
+// Read and discard `count` bytes; returns bytes skipped or -1 on error
+zip_int64_t zip_skip(zip_file_t* zf, uint64_t count) {
+    char discard_buf[4096];
+    uint64_t remaining = count;
+    while (remaining > 0) {
+        size_t to_read = (remaining > sizeof(discard_buf)) ? sizeof(discard_buf) : remaining;
+        zip_int64_t result = zip_fread(zf, discard_buf, to_read);
+        if (result < 0) {
+            return -1;
+        }
+        if (result == 0) {
+            break;
+        }
+        remaining -= result;
+    }
+    return count - remaining;
+}
+
+} // namespace
+
+FileHandle::FileHandle(const FileEntry* entry, Archive* archive)
+    : entry_(entry), archive_(archive), data_offset_(kUnresolved), zip_file_(nullptr), zip_pos_(0) {
+    if (entry->need_decompression()) {
+        bool deflated = entry->compression_method() == ZIP_CM_DEFLATE && !entry->encrypted();
+        strategy_ = deflated ? ReadStrategy::INFLATE : ReadStrategy::LIBZIP;
+    } else if (archive->mapped()) {
+        strategy_ = ReadStrategy::MMAP;
+    } else if (archive->direct()) {
+        strategy_ = ReadStrategy::DIRECT;
+    } else {
+        strategy_ = ReadStrategy::PREAD;
+    }
+}
+
+FileHandle::~FileHandle() {
+    close_zip_file();
+}
+
+int FileHandle::resolve() {
+    if (data_offset_ != kUnresolved) {
+        return 0;
+    }
+    int64_t offset = archive_->data_offset(entry_->header_offset(), entry_->compressed_size());
+    if (offset < 0) {
+        std::cerr << "Invalid local header for " << entry_->name() << " in " << archive_->path() << std::endl;
+        return static_cast<int>(offset);
+    }
+    data_offset_ = offset;
+    return 0;
+}
+
+int FileHandle::open() {
+    // The handle is not shared yet, so reads find the offset set
+    int res = resolve();
+    if (res < 0) {
+        return res;
+    }
+
+    // Compressed entries are consumed whole from here on
+    Prefetcher::get_instance().access(*archive_, data_offset_,
+                                      entry_->need_decompression() ? entry_->compressed_size() : 0);
+
+    auto& cache = EntryCache::get_instance();
+    if (!entry_->need_decompression() || !cache.cacheable(entry_)) {
+        return 0;
+    }
+
+    CachedData data = cache.lookup(entry_);
+    if (!data) {
+        std::vector<char> contents(entry_->size());
+        size_t filled = 0;
+        while (filled < contents.size()) {
+            res = read(contents.data() + filled, contents.size() - filled, filled);
+            if (res < 0) {
+                return res;
+            }
+            if (res == 0) {
+                break;
+            }
+            filled += res;
+        }
+        contents.resize(filled);
+        data = cache.insert(entry_, std::move(contents));
+    }
+
+    cached_ = std::move(data);
+    strategy_ = ReadStrategy::CACHED;
+
+    // Reads no longer decode; drop the decoder used to fill the cache and
+    // give the libzip handle back to the pool. The handle is not shared yet.
+    inflate_.reset();
+    close_zip_file();
+    zip_.reset();
+    return 0;
+}
+
+int FileHandle::read(char* buf, size_t size, off_t offset) {
+    // Check bounds
+    if (offset >= (off_t)entry_->size()) {
+        return 0;
+    }
+
+    // Adjust size if reading past end of file
+    if (offset + size > entry_->size()) {
+        size = entry_->size() - offset;
+    }
+
+    // Only handles that were never opened get here unresolved
+    int res = resolve();
+    if (res < 0) {
+        return res;
+    }
+
+    if (strategy_ == ReadStrategy::PREAD || strategy_ == ReadStrategy::MMAP) {
+        Prefetcher::get_instance().access(*archive_, data_offset_ + offset, size);
+    }
+
+    switch (strategy_) {
+    case ReadStrategy::PREAD:
+        // Stored entries: the data lives verbatim in the archive
+        return archive_->pread(buf, size, data_offset_ + offset);
+    case ReadStrategy::MMAP:
+        std::memcpy(buf, archive_->data() + data_offset_ + offset, size);
+        return size;
+    case ReadStrategy::DIRECT:
+        return archive_->pread_direct(buf, size, data_offset_ + offset);
+    case ReadStrategy::CACHED:
+        if ((size_t)offset >= cached_->size()) {
+            return 0;
+        }
+        size = std::min(size, cached_->size() - offset);
+        std::memcpy(buf, cached_->data() + offset, size);
+        return size;
+    case ReadStrategy::INFLATE:
+        return read_inflate(buf, size, offset);
+    case ReadStrategy::LIBZIP:
+        return read_libzip(buf, size, offset);
+    }
+    return -EIO;
+}
+
+int FileHandle::read_inflate(char* buf, size_t size, off_t offset) {
+    auto& index = InflateIndex::get_instance();
+
+    std::unique_lock<std::mutex> lock(stream_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        // The live decoder is busy with a concurrent read on this handle
+        return index.read(entry_, *archive_, data_offset_, buf, size, offset);
+    }
+
+    // Continue if the read starts at or shortly after the current position;
+    // anything else restarts from the nearest checkpoint
+    bool resume = inflate_ && (uint64_t)offset >= inflate_->position() &&
+                  (uint64_t)offset - inflate_->position() <= index.span();
+    if (!resume) {
+        if (!inflate_) {
+            inflate_ = std::make_unique<InflateStream>(entry_, archive_, data_offset_);
+        }
+        int res = index.seek(*inflate_, entry_, offset);
+        if (res < 0) {
+            inflate_.reset();
+            return res;
+        }
+    }
+
+    ssize_t res = inflate_->read(buf, size, offset);
+    if (res < 0) {
+        inflate_.reset();
+    }
+    return res;
+}
+
+void FileHandle::close_zip_file() {
+    if (zip_file_) {
+        zip_fclose(zip_file_);
+        zip_file_ = nullptr;
+    }
+    zip_pos_ = 0;
+}
+
+int FileHandle::read_libzip(char* buf, size_t size, off_t offset) {
+    std::unique_lock<std::mutex> lock(stream_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        // The live decoder is busy with a concurrent read on this handle
+        return read_libzip_once(buf, size, offset);
+    }
+
+    // libzip cannot seek backwards in compressed data
+    if (zip_file_ && (uint64_t)offset < zip_pos_) {
+        close_zip_file();
+    }
+
+    if (!zip_file_) {
+        // The lease is held until release() so the file stays usable
+        if (!zip_) {
+            zip_ = std::make_unique<ZipHandle>(*archive_);
+        }
+        if (!*zip_) {
+            zip_.reset();
+            return -EIO;
+        }
+
+        zip_file_ = zip_fopen_index(zip_->get(), entry_->zip_index(), 0);
+        if (zip_file_ == nullptr) {
+            std::cerr << "Failed to open file in ZIP at index " << entry_->zip_index() << std::endl;
+            return -EIO;
+        }
+        zip_pos_ = 0;
+    }
+
+    zip_int64_t skipped = zip_skip(zip_file_, offset - zip_pos_);
+    if (skipped < 0) {
+        close_zip_file();
+        return -EIO;
+    }
+    zip_pos_ += skipped;
+    if (zip_pos_ < (uint64_t)offset) {
+        return 0;
+    }
+
+    zip_int64_t bytes_read = zip_fread(zip_file_, buf, size);
+    if (bytes_read < 0) {
+        close_zip_file();
+        return -EIO;
+    }
+
+    zip_pos_ += bytes_read;
+    return bytes_read;
+}
+
+int FileHandle::read_libzip_once(char* buf, size_t size, off_t offset) {
+    // Lease a libzip handle; they are opened once and reused across reads
+    ZipHandle za(*archive_);
+    if (!za) {
+        return -EIO;
+    }
+
+    // Open the file within the ZIP
+    zip_file_t* zf = zip_fopen_index(za.get(), entry_->zip_index(), 0);
+    if (zf == nullptr) {
+        std::cerr << "Failed to open file in ZIP at index " << entry_->zip_index() << std::endl;
+        return -EIO;
+    }
+
+    // Seek to the offset if needed
+    if (offset > 0 && zip_skip(zf, offset) < 0) {
+        zip_fclose(zf);
+        return -EIO;
+    }
+
+    // Read the actual data
+    zip_int64_t bytes_read = zip_fread(zf, buf, size);
+
+    zip_fclose(zf);
+
+    if (bytes_read < 0) {
+        return -EIO;
+    }
+
+    return bytes_read;
+}
+
+} // namespace scalable_zip_fs
@@ -0,0 +1,266 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+#include "snapshot.hpp"
+#include "zipdir.hpp"
+
+namespace scalable_zip_fs {
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'Z', 'F', 'S', 'I', 'D', 'X', '\0'};
+constexpr uint32_t kVersion = 4;
+
+// Byte order and layout check: a snapshot written on a host with
+// different record layouts never matches
+constexpr uint32_t kLayoutTag = 0x01020304u ^ static_cast<uint32_t>(
+    sizeof(FileEntry) << 16 | sizeof(DirectoryEntry) << 8 | sizeof(CompressedInfo));
+
+constexpr uint32_t kByOffset = 1;
+
+struct ArchiveRecord {
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t cd_crc32;
+    uint32_t path_len;
+};
+
+// `count` records starting `offset` bytes into the file
+struct Section {
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;
+    uint32_t flags;
+    uint32_t reserved;
+    Section archives;       // ArchiveRecord, in mount order
+    Section paths;          // Archive paths, back to back
+    Section names;
+    Section dirs;
+    Section files;
+    Section compressed;
+    Section path_tags;
+    Section path_refs;
+    Section listing_order;  // Empty for name order
+};
+
+inline uint64_t align8(uint64_t v) {
+    return (v + 7) & ~uint64_t(7);
+}
+
+bool write_all(int fd, const void* buf, size_t len) {
+    const char* p = static_cast<const char*>(buf);
+    while (len > 0) {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Records of `section` if they lie within the `size` byte mapping `map`
+template <typename T>
+const T* section_data(const char* map, size_t size, const Section& section) {
+    if (section.offset % alignof(T) != 0 || section.offset > size ||
+        section.count > (size - section.offset) / sizeof(T)) {
+        return nullptr;
+    }
+    return reinterpret_cast<const T*>(map + section.offset);
+}
+
+} // namespace
+
+IndexSnapshot::~IndexSnapshot() {
+    if (map_) {
+        munmap(const_cast<char*>(map_), size_);
+    }
+}
+
+SnapshotKey IndexSnapshot::key_for(const Archive& archive) {
+    struct stat sb;
+    if (fstat(archive.fd(), &sb) != 0) {
+        throw std::runtime_error("Failed to stat ZIP file: " + archive.path());
+    }
+    CentralDirectory cd(archive.fd(), archive.path());
+
+    SnapshotKey key;
+    key.path = archive.path();
+    key.size = cd.archive_size();
+    key.mtime_sec = sb.st_mtim.tv_sec;
+    key.mtime_nsec = sb.st_mtim.tv_nsec;
+    key.cd_crc32 = cd.checksum();
+    return key;
+}
+
+std::filesystem::path IndexSnapshot::file_for(const std::filesystem::path& dir, const std::vector<SnapshotKey>& keys,
+                                              bool by_offset) {
+    std::string id = by_offset ? "offset" : "name";
+    for (const auto& key : keys) {
+        id += '\0';
+        id += key.path;
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016zx.idx", std::hash<std::string>()(id));
+    return dir / name;
+}
+
+std::shared_ptr<const IndexSnapshot> IndexSnapshot::load(const std::filesystem::path& file,
+                                                         const std::vector<SnapshotKey>& keys, bool by_offset) {
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return nullptr;
+    }
+    void* map = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return nullptr;
+    }
+
+    std::shared_ptr<IndexSnapshot> snapshot(new IndexSnapshot());
+    snapshot->map_ = static_cast<const char*>(map);
+    snapshot->size_ = sb.st_size;
+
+    const char* base = snapshot->map_;
+    size_t size = snapshot->size_;
+    const auto* hdr = reinterpret_cast<const SnapshotHeader*>(base);
+    if (std::memcmp(hdr->magic, kMagic, sizeof(kMagic)) != 0 || hdr->version != kVersion ||
+        hdr->layout != kLayoutTag || hdr->flags != (by_offset ? kByOffset : 0)) {
+        return nullptr;
+    }
+
+    // Every archive, in the same order, unchanged
+    const auto* records = section_data<ArchiveRecord>(base, size, hdr->archives);
+    const char* paths = section_data<char>(base, size, hdr->paths);
+    if (!records || !paths || hdr->archives.count != keys.size()) {
+        return nullptr;
+    }
+    uint64_t path_pos = 0;
+    for (size_t k = 0; k < keys.size(); k++) {
+        const ArchiveRecord& rec = records[k];
+        const SnapshotKey& key = keys[k];
+        if (rec.size != key.size || rec.mtime_sec != key.mtime_sec || rec.mtime_nsec != key.mtime_nsec ||
+            rec.cd_crc32 != key.cd_crc32 || rec.path_len != key.path.size() ||
+            rec.path_len > hdr->paths.count - path_pos ||
+            std::memcmp(paths + path_pos, key.path.data(), key.path.size()) != 0) {
+            return nullptr;
+        }
+        path_pos += rec.path_len;
+    }
+
+    // The contents of the arrays are checked by ZipEntryManagerImpl
+    FrozenIndex& index = snapshot->index_;
+    index.names = section_data<char>(base, size, hdr->names);
+    index.names_size = hdr->names.count;
+    index.dirs = section_data<DirectoryEntry>(base, size, hdr->dirs);
+    index.num_dirs = hdr->dirs.count;
+    index.files = section_data<FileEntry>(base, size, hdr->files);
+    index.num_files = hdr->files.count;
+    index.compressed = section_data<CompressedInfo>(base, size, hdr->compressed);
+    index.num_compressed = hdr->compressed.count;
+    index.path_tags = section_data<uint8_t>(base, size, hdr->path_tags);
+    index.path_refs = section_data<uint32_t>(base, size, hdr->path_refs);
+    index.path_capacity = hdr->path_tags.count;
+    index.listing_order = by_offset ? section_data<uint32_t>(base, size, hdr->listing_order) : nullptr;
+
+    if (!index.names || !index.dirs || !index.files || !index.compressed || !index.path_tags ||
+        !index.path_refs || hdr->path_refs.count != index.path_capacity ||
+        (by_offset && (!index.listing_order || hdr->listing_order.count != index.num_files))) {
+        return nullptr;
+    }
+    return snapshot;
+}
+
+bool IndexSnapshot::save(const std::filesystem::path& file, const std::vector<SnapshotKey>& keys,
+                         const FrozenIndex& index) {
+    SnapshotHeader hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    std::memcpy(hdr.magic, kMagic, sizeof(kMagic));
+    hdr.version = kVersion;
+    hdr.layout = kLayoutTag;
+    hdr.flags = index.listing_order ? kByOffset : 0;
+
+    std::vector<ArchiveRecord> records;
+    std::string paths;
+    for (const auto& key : keys) {
+        records.push_back({key.size, key.mtime_sec, key.mtime_nsec, key.cd_crc32,
+                           static_cast<uint32_t>(key.path.size())});
+        paths += key.path;
+    }
+
+    struct Part {
+        Section* section;
+        const void* data;
+        uint64_t count;
+        size_t record_size;
+    };
+    Part parts[] = {
+        {&hdr.archives, records.data(), records.size(), sizeof(ArchiveRecord)},
+        {&hdr.paths, paths.data(), paths.size(), 1},
+        {&hdr.names, index.names, index.names_size, 1},
+        {&hdr.dirs, index.dirs, index.num_dirs, sizeof(DirectoryEntry)},
+        {&hdr.files, index.files, index.num_files, sizeof(FileEntry)},
+        {&hdr.compressed, index.compressed, index.num_compressed, sizeof(CompressedInfo)},
+        {&hdr.path_tags, index.path_tags, index.path_capacity, sizeof(uint8_t)},
+        {&hdr.path_refs, index.path_refs, index.path_capacity, sizeof(uint32_t)},
+        {&hdr.listing_order, index.listing_order, index.listing_order ? index.num_files : 0, sizeof(uint32_t)},
+    };
+
+    // Sections follow the header in order, each 8-byte aligned
+    uint64_t pos = sizeof(hdr);
+    for (Part& part : parts) {
+        pos = align8(pos);
+        part.section->offset = pos;
+        part.section->count = part.count;
+        pos += part.count * part.record_size;
+    }
+
+    // Write next to the final name and rename, so a reader never maps a
+    // partial file and concurrent mounts do not interfere
+    std::filesystem::path tmp = file;
+    tmp += "." + std::to_string(getpid()) + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    static const char zeros[8] = {};
+    bool ok = write_all(fd, &hdr, sizeof(hdr));
+    pos = sizeof(hdr);
+    for (const Part& part : parts) {
+        ok = ok && write_all(fd, zeros, part.section->offset - pos) &&
+             write_all(fd, part.data, part.count * part.record_size);
+        pos = part.section->offset + part.count * part.record_size;
+    }
+    ok = close(fd) == 0 && ok;
+
+    if (!ok || rename(tmp.c_str(), file.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace scalable_zip_fs
@@ -0,0 +1,50 @@
+#include <sstream>
+
+#include "dirent_cache.hpp"
+#include "entry_cache.hpp"
+#include "inflate.hpp"
+#include "prefetch.hpp"
+#include "stats.hpp"
+#include "zipent.hpp"
+
+namespace scalable_zip_fs {
+
+std::string format_stats() {
+    std::ostringstream out;
+
+    auto& manager = ZipEntryManager::get_instance();
+    out << "index_files " << manager.num_files() << "\n";
+    out << "index_dirs " << manager.num_dirs() << "\n";
+    out << "index_bytes " << manager.memory_used() << "\n";
+
+    auto& cache = EntryCache::get_instance();
+    out << "entry_cache_hits " << cache.hits() << "\n";
+    out << "entry_cache_misses " << cache.misses() << "\n";
+    out << "entry_cache_evictions " << cache.evictions() << "\n";
+    out << "entry_cache_entries " << cache.entries() << "\n";
+    out << "entry_cache_bytes " << cache.bytes() << "\n";
+
+    auto& prefetcher = Prefetcher::get_instance();
+    out << "prefetch_bytes " << prefetcher.issued_bytes() << "\n";
+    out << "prefetch_resets " << prefetcher.resets() << "\n";
+
+    out << "inflate_index_bytes " << InflateIndex::get_instance().memory_used() << "\n";
+
+    auto& dirents = DirentCache::get_instance();
+    out << "dirent_cache_hits " << dirents.hits() << "\n";
+    out << "dirent_cache_misses " << dirents.misses() << "\n";
+    out << "dirent_cache_bytes " << dirents.bytes() << "\n";
+
+    auto& requests = RequestCounters::get_instance();
+    uint64_t lookups = requests.lookups.load(std::memory_order_relaxed);
+    uint64_t getattrs = requests.getattrs.load(std::memory_order_relaxed);
+    uint64_t readdirs = requests.readdirs.load(std::memory_order_relaxed);
+    out << "metadata_requests " << lookups + getattrs + readdirs << "\n";
+    out << "lookup_requests " << lookups << "\n";
+    out << "getattr_requests " << getattrs << "\n";
+    out << "readdir_requests " << readdirs << "\n";
+
+    return out.str();
+}
+
+} // namespace scalable_zip_fs
@@ -1,57 +1,231 @@
 #include <cassert>
-#include <list>
+#include <cstring>
+#include <memory>
 #include <string>
 #include <tuple>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #include "utils.hpp"
 
 namespace scalable_zip_fs {
 
-PathSplit::PathSplit(const char* pathptr, const size_t pathlen) {
+namespace {
+
+#if defined(__x86_64__)
+
+size_t find_separator_sse2(const char* p, size_t len) {
+    const __m128i slash = _mm_set1_epi8('/');
     size_t i = 0;
-    size_t seg_start = 0;
-    size_t seg_end = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, slash));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    for (; i < len; i++) {
+        if (p[i] == '/') {
+            return i;
+        }
+    }
+    return len;
+}
+
+__attribute__((target("avx2")))
+size_t find_separator_avx2(const char* p, size_t len) {
+    const __m256i slash = _mm256_set1_epi8('/');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, slash));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    // The tail stays in this function: handing it to SSE code with the
+    // upper halves of the ymm registers dirty costs a state transition
+    if (i + 16 <= len) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(slash)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+    for (; i < len; i++) {
+        if (p[i] == '/') {
+            return i;
+        }
+    }
+    return len;
+}
+
+#else
+
+size_t find_separator_scalar(const char* p, size_t len) {
+    const void* hit = std::memchr(p, '/', len);
+    return hit ? static_cast<const char*>(hit) - p : len;
+}
+
+#endif
+
+typedef size_t (*FindSeparatorFn)(const char*, size_t);
 
-    bool seg_found = false;
+FindSeparatorFn select_find_separator() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return find_separator_avx2;
+    }
+    return find_separator_sse2;
+#else
+    return find_separator_scalar;
+#endif
+}
+
+// Picked once, before main() runs
+const FindSeparatorFn find_separator_impl = select_find_separator();
+
+} // namespace
+
+size_t find_separator(const char* p, size_t len) {
+    // Components shorter than 16 bytes end within the inline scan; only
+    // longer ones are worth the vector setup
+    size_t head = len < 16 ? len : 16;
+    for (size_t i = 0; i < head; i++) {
+        if (p[i] == '/') {
+            return i;
+        }
+    }
+    if (head == len) {
+        return len;
+    }
+    return head + find_separator_impl(p + head, len - head);
+}
+
+PathSegments::~PathSegments() {
+    if (data_ != reinterpret_cast<value_type*>(inline_)) {
+        ::operator delete(data_);
+    }
+}
+
+void PathSegments::grow() {
+    size_t capacity = capacity_ * 2;
+    auto* data = static_cast<value_type*>(::operator new(capacity * sizeof(value_type)));
+    std::uninitialized_copy(begin(), end(), data);
+    if (data_ != reinterpret_cast<value_type*>(inline_)) {
+        ::operator delete(data_);
+    }
+    data_ = data;
+    capacity_ = capacity;
+}
+
+PathSplit::PathSplit(const char* pathptr, const size_t pathlen) {
     bool last_was_dots = false;
 
     is_dir_ = false;
     if (pathlen > 0) {
         assert(pathptr != nullptr);
+        is_dir_ = pathptr[pathlen - 1] == '/';
     }
-    if (pathlen > 0)
-        is_dir_ = pathptr[pathlen-1] == '/';
-    
-    while (i <= pathlen) {
-        seg_found = false;
-        if (i == pathlen || pathptr[i] == '/') {
-            seg_end = i;
-            seg_found = true;
-        }
-        
-        if (seg_found) {
-            last_was_dots = false;
-            size_t seg_len = seg_end - seg_start;
-            if (seg_len) {
-                if (seg_len == 1 && pathptr[seg_start] == '.') {
-                    last_was_dots = true;
-                } else if (seg_len == 2 && pathptr[seg_start] == '.' && pathptr[seg_start + 1] == '.') {
-                    if (!segments_.empty()) {
-                        segments_.pop_back();
-                    }
-                    last_was_dots = true;
-                } else {
-                    segments_.push_back(std::make_tuple(seg_start, seg_end));
-                }
+
+    size_t seg_start = 0;
+    while (seg_start <= pathlen) {
+        size_t seg_end = seg_start + find_separator(pathptr + seg_start, pathlen - seg_start);
+        size_t seg_len = seg_end - seg_start;
+
+        last_was_dots = false;
+        if (seg_len == 1 && pathptr[seg_start] == '.') {
+            last_was_dots = true;
+        } else if (seg_len == 2 && pathptr[seg_start] == '.' && pathptr[seg_start + 1] == '.') {
+            if (!segments_.empty()) {
+                segments_.pop_back();
             }
-            seg_start = i + 1;
+            last_was_dots = true;
+        } else if (seg_len) {
+            segments_.push_back(seg_start, seg_end);
         }
-        i++;
+        seg_start = seg_end + 1;
     }
-    
+
     is_dir_ |= last_was_dots;
 }
 
+namespace {
+
+
+inline uint64_t read64(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t read32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// 64x64 -> 128 bit multiply, folded
+inline uint64_t mix(uint64_t a, uint64_t b) {
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+constexpr uint64_t kSecret0 = 0xa0761d6478bd642full;
+constexpr uint64_t kSecret1 = 0xe7037ed1a0b428dbull;
+constexpr uint64_t kSecret2 = 0x8ebc6af09c88c6e3ull;
+constexpr uint64_t kSecret3 = 0x589965cc75374cc3ull;
+
+} // namespace
+
+uint64_t hash_bytes(const char* p, size_t len) {
+    uint64_t seed = mix(kSecret0, kSecret1);
+    uint64_t a;
+    uint64_t b;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            size_t mid = (len >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + mid);
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - mid);
+        } else if (len > 0) {
+            const auto* u = reinterpret_cast<const unsigned char*>(p);
+            a = (static_cast<uint64_t>(u[0]) << 16) | (static_cast<uint64_t>(u[len >> 1]) << 8) | u[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t seed1 = seed;
+            uint64_t seed2 = seed;
+            do {
+                seed = mix(read64(p) ^ kSecret1, read64(p + 8) ^ seed);
+                seed1 = mix(read64(p + 16) ^ kSecret2, read64(p + 24) ^ seed1);
+                seed2 = mix(read64(p + 32) ^ kSecret3, read64(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (i > 16) {
+            seed = mix(read64(p) ^ kSecret1, read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+
+    __uint128_t r = static_cast<__uint128_t>(a ^ kSecret1) * (b ^ seed);
+    return mix(static_cast<uint64_t>(r) ^ kSecret0 ^ len, static_cast<uint64_t>(r >> 64) ^ kSecret1);
+}
+
 PathSplit::PathSplit(const std::string& path): PathSplit::PathSplit(path.c_str(), path.length()) { }
 
 
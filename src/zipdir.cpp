@@ -0,0 +1,211 @@
+#include <zlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include "zipdir.hpp"
+
+namespace scalable_zip_fs {
+
+namespace {
+
+constexpr uint32_t kLocalHeaderSig = 0x04034b50;
+constexpr uint32_t kCentralHeaderSig = 0x02014b50;
+constexpr uint32_t kEocdSig = 0x06054b50;
+constexpr uint32_t kEocd64LocatorSig = 0x07064b50;
+constexpr uint32_t kEocd64Sig = 0x06064b50;
+
+constexpr size_t kCentralHeaderSize = 46;
+constexpr size_t kEocdSize = 22;
+constexpr size_t kEocd64LocatorSize = 20;
+constexpr size_t kEocd64Size = 56;
+
+constexpr uint16_t kZip64ExtraId = 0x0001;
+
+inline uint16_t read_le16(const unsigned char* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t read_le32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t read_le64(const unsigned char* p) {
+    return static_cast<uint64_t>(read_le32(p)) | (static_cast<uint64_t>(read_le32(p + 4)) << 32);
+}
+
+} // namespace
+
+uint64_t local_header_length(const unsigned char* header) {
+    if (read_le32(header) != kLocalHeaderSig) {
+        return 0;
+    }
+    return kLocalHeaderSize + read_le16(header + 26) + read_le16(header + 28);
+}
+
+CentralDirectory::CentralDirectory(int fd, const std::string& path)
+    : path_(path), map_(nullptr), size_(0), cd_(nullptr), cd_size_(0), num_entries_(0) {
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) {
+        throw std::runtime_error("Failed to stat ZIP file: " + path_);
+    }
+    size_ = sb.st_size;
+    if (size_ < kEocdSize) {
+        throw std::runtime_error("Not a ZIP file: " + path_);
+    }
+
+    void* map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("Failed to map ZIP file: " + path_);
+    }
+    map_ = static_cast<const unsigned char*>(map);
+
+    try {
+        locate();
+    } catch (...) {
+        munmap(const_cast<unsigned char*>(map_), size_);
+        throw;
+    }
+}
+
+CentralDirectory::~CentralDirectory() {
+    munmap(const_cast<unsigned char*>(map_), size_);
+}
+
+void CentralDirectory::locate() {
+    // The EOCD record sits in the last 22 bytes plus up to 64 KiB of comment
+    uint64_t eocd_pos = size_ - kEocdSize;
+    uint64_t lowest = size_ - std::min<uint64_t>(size_, kEocdSize + 0xFFFF);
+    while (read_le32(map_ + eocd_pos) != kEocdSig) {
+        if (eocd_pos == lowest) {
+            throw std::runtime_error("End of central directory not found: " + path_);
+        }
+        eocd_pos--;
+    }
+
+    const unsigned char* eocd = map_ + eocd_pos;
+    uint64_t num_entries = read_le16(eocd + 10);
+    uint64_t cd_size = read_le32(eocd + 12);
+    uint64_t cd_offset = read_le32(eocd + 16);
+
+    // ZIP64 archives keep the real values in the ZIP64 EOCD record
+    if (num_entries == 0xFFFF || cd_size == 0xFFFFFFFF || cd_offset == 0xFFFFFFFF) {
+        if (eocd_pos < kEocd64LocatorSize ||
+            read_le32(map_ + eocd_pos - kEocd64LocatorSize) != kEocd64LocatorSig) {
+            throw std::runtime_error("ZIP64 locator not found: " + path_);
+        }
+        uint64_t eocd64_pos = read_le64(map_ + eocd_pos - kEocd64LocatorSize + 8);
+        if (size_ < kEocd64Size || eocd64_pos > size_ - kEocd64Size || read_le32(map_ + eocd64_pos) != kEocd64Sig) {
+            throw std::runtime_error("Invalid ZIP64 end of central directory: " + path_);
+        }
+        const unsigned char* eocd64 = map_ + eocd64_pos;
+        num_entries = read_le64(eocd64 + 32);
+        cd_size = read_le64(eocd64 + 40);
+        cd_offset = read_le64(eocd64 + 48);
+    }
+
+    if (cd_offset > size_ || cd_size > size_ - cd_offset) {
+        throw std::runtime_error("Central directory out of bounds: " + path_);
+    }
+
+    cd_ = map_ + cd_offset;
+    cd_size_ = cd_size;
+    num_entries_ = num_entries;
+
+    // The whole directory is about to be walked front to back
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = reinterpret_cast<uintptr_t>(cd_) & ~(page - 1);
+    madvise(reinterpret_cast<void*>(start), reinterpret_cast<uintptr_t>(cd_) + cd_size_ - start,
+            MADV_WILLNEED);
+}
+
+uint32_t CentralDirectory::checksum() const {
+    uLong crc = crc32(0L, Z_NULL, 0);
+    for (uint64_t pos = 0; pos < cd_size_; ) {
+        uInt len = std::min<uint64_t>(cd_size_ - pos, 1u << 30);
+        crc = crc32(crc, cd_ + pos, len);
+        pos += len;
+    }
+    return static_cast<uint32_t>(crc);
+}
+
+bool CentralDirectory::next(uint64_t& pos, CentralRecord& rec) const {
+    if (pos + kCentralHeaderSize > cd_size_ || read_le32(cd_ + pos) != kCentralHeaderSig) {
+        return false;
+    }
+
+    const unsigned char* hdr = cd_ + pos;
+    rec.flags = read_le16(hdr + 8);
+    rec.method = read_le16(hdr + 10);
+    rec.crc32 = read_le32(hdr + 16);
+    rec.compressed_size = read_le32(hdr + 20);
+    rec.size = read_le32(hdr + 24);
+    uint16_t name_len = read_le16(hdr + 28);
+    uint16_t extra_len = read_le16(hdr + 30);
+    uint16_t comment_len = read_le16(hdr + 32);
+    rec.local_header_offset = read_le32(hdr + 42);
+
+    uint64_t extra_pos = pos + kCentralHeaderSize + name_len;
+    uint64_t extra_end = extra_pos + extra_len;
+    if (extra_end + comment_len > cd_size_) {
+        throw std::runtime_error("Truncated central directory: " + path_);
+    }
+    rec.name = reinterpret_cast<const char*>(hdr + kCentralHeaderSize);
+    rec.name_len = name_len;
+
+    // ZIP64 extended information holds, in order, whichever of the three
+    // fields overflowed
+    if (rec.size == 0xFFFFFFFF || rec.compressed_size == 0xFFFFFFFF ||
+        rec.local_header_offset == 0xFFFFFFFF) {
+        while (extra_pos + 4 <= extra_end) {
+            uint16_t id = read_le16(cd_ + extra_pos);
+            uint16_t len = read_le16(cd_ + extra_pos + 2);
+            uint64_t field = extra_pos + 4;
+            uint64_t field_end = std::min(field + len, extra_end);
+            if (id == kZip64ExtraId) {
+                for (uint64_t* value : {&rec.size, &rec.compressed_size, &rec.local_header_offset}) {
+                    if (*value != 0xFFFFFFFF) {
+                        continue;
+                    }
+                    if (field + 8 > field_end) {
+                        throw std::runtime_error("Truncated ZIP64 extra field in " + path_);
+                    }
+                    *value = read_le64(cd_ + field);
+                    field += 8;
+                }
+                break;
+            }
+            extra_pos = field + len;
+        }
+    }
+
+    pos = extra_end + comment_len;
+    return true;
+}
+
+std::vector<DirectoryRange> CentralDirectory::split(size_t parts) const {
+    uint64_t per_range = std::max<uint64_t>(1, (num_entries_ + parts - 1) / std::max<size_t>(parts, 1));
+
+    std::vector<DirectoryRange> ranges;
+    uint64_t pos = 0;
+    uint64_t index = 0;
+    while (pos + kCentralHeaderSize <= cd_size_ && read_le32(cd_ + pos) == kCentralHeaderSig) {
+        if (index % per_range == 0) {
+            ranges.push_back({pos, index});
+        }
+        const unsigned char* hdr = cd_ + pos;
+        pos += kCentralHeaderSize + read_le16(hdr + 28) + read_le16(hdr + 30) + read_le16(hdr + 32);
+        index++;
+    }
+    if (pos > cd_size_) {
+        throw std::runtime_error("Truncated central directory: " + path_);
+    }
+
+    ranges.push_back({pos, index});
+    return ranges;
+}
+
+} // namespace scalable_zip_fs
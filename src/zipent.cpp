@@ -1,198 +1,899 @@
 #include <zip.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <stdexcept>
 #include <cstring>
+#include <thread>
+#include <unordered_map>
+#include "snapshot.hpp"
+#include "zipdir.hpp"
 #include "zipent.hpp"
 
 namespace scalable_zip_fs {
 
-ZipEntryManagerImpl::ZipEntryManagerImpl() {
-    root_.parent_ = nullptr;
-    root_.name_ = &zip_path_lst_.emplace_back("");
+ZipEntryManagerImpl::ZipEntryManagerImpl()
+    : listing_by_offset_(false), names_(nullptr), names_size_(1), dirs_(nullptr), num_dirs_(1),
+      files_(nullptr), num_files_(0), compressed_(nullptr), num_compressed_(0),
+      path_tags_(nullptr), path_refs_(nullptr), path_capacity_(0), listing_order_(nullptr) {
+    // An empty root until index_zipfiles() replaces it
+    std::unique_ptr<DirectoryEntry[]> dirs(new DirectoryEntry[1]);
+    DirectoryEntry& root = dirs[0];
+    root.name_ = 0;
+    root.name_len_ = 0;
+    root.parent_ = DirectoryEntry::kNoParent;
+    root.first_dir_ = 1;
+    root.num_dirs_ = 0;
+    root.first_file_ = 0;
+    root.num_files_ = 0;
+
+    names_ = keep(std::unique_ptr<char[]>(new char[1]()));
+    dirs_ = keep(std::move(dirs));
 }
 
-void ZipEntryManagerImpl::index_zipfile(const std::filesystem::path& path) {
-    // Convert to absolute path to handle relative paths
-    std::filesystem::path abs_path = std::filesystem::absolute(path);
+namespace {
+
+// Below this many records per thread, splitting the directory costs more
+// than it saves
+constexpr uint64_t kMinRangeEntries = 65536;
+
+// Run `fn(k)` for every k < `count` on up to `threads` threads, then
+// rethrow the first failure
+template <typename Fn>
+void for_each_parallel(size_t count, unsigned threads, Fn fn) {
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<size_t> next(0);
+    {
+        std::vector<std::jthread> pool;
+        threads = std::max<size_t>(1, std::min<size_t>(threads, count));
+        for (unsigned t = 0; t < threads; t++) {
+            pool.emplace_back([&]() {
+                for (size_t k = next++; k < count; k = next++) {
+                    try {
+                        fn(k);
+                    } catch (...) {
+                        errors[k] = std::current_exception();
+                    }
+                }
+            });
+        }
+    }
+    for (auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
 
-    int err = 0;
-    zip_t* za = zip_open(abs_path.c_str(), ZIP_RDONLY, &err);
+// Append the records in [pos, end) of `cd`, the first of which has index
+// `index`, to `out`; returns the number of records read
+uint64_t parse_range(const CentralDirectory& cd, const std::string& path,
+                     uint64_t pos, uint64_t end, uint64_t index, PartialIndex& out) {
+    CentralRecord rec;
+    uint64_t i = index;
+    for (; pos < end && cd.next(pos, rec); i++) {
+        // Skip directories (entries ending with '/')
+        if (rec.name_len > 0 && rec.name[rec.name_len - 1] == '/') {
+            out.skipped_dirs++;
+            continue;
+        }
 
-    if (za == nullptr) {
-        zip_error_t error;
-        zip_error_init_with_code(&error, err);
-        std::string error_msg = "Failed to open ZIP file: " + abs_path.string() + " - " + zip_error_strerror(&error);
-        zip_error_fini(&error);
-        throw std::runtime_error(error_msg);
+        PartialEntry entry = {};
+        entry.name_offset = out.name_storage.size();
+        entry.name_len = rec.name_len;
+        entry.size = rec.size;
+        entry.compressed_size = rec.compressed_size;
+        entry.zip_index = i;
+        entry.compression_method = rec.method;
+        entry.encrypted = rec.encrypted();
+
+        // The local header is left for open() to read, so nothing here
+        // touches the archive outside the central directory. The data
+        // follows at least the header's fixed part; open() checks the rest.
+        entry.header_offset = rec.local_header_offset;
+
+        // Never hand out reads beyond the end of the archive
+        bool compressed = entry.compression_method != ZIP_CM_STORE || entry.encrypted;
+        uint64_t stored_size = compressed ? entry.compressed_size : entry.size;
+        uint64_t available = cd.archive_size() - std::min(cd.archive_size(), entry.header_offset);
+        if (available < kLocalHeaderSize || stored_size > available - kLocalHeaderSize) {
+            std::cerr << "Warning: Entry data out of bounds in " << path << ": "
+                      << std::string_view(rec.name, rec.name_len) << std::endl;
+            out.skipped_invalid++;
+            continue;
+        }
+        // File records hold 48-bit sizes and 47-bit offsets
+        if (entry.size > FileEntry::kMaxSize || entry.header_offset > FileEntry::kMaxOffset) {
+            std::cerr << "Warning: Entry too large to index in " << path << ": "
+                      << std::string_view(rec.name, rec.name_len) << std::endl;
+            out.skipped_invalid++;
+            continue;
+        }
+
+        out.name_storage.insert(out.name_storage.end(), rec.name, rec.name + rec.name_len);
+        out.entry_storage.push_back(entry);
     }
+    return i - index;
+}
 
-    // Store the absolute ZIP file path
-    size_t zip_idx = zip_path_lst_.size();
-    zip_path_lst_.push_back(abs_path.string());
+} // namespace
+
+PartialIndex ZipEntryManagerImpl::parse_archive(std::unique_ptr<Archive> archive, unsigned threads) const {
+    PartialIndex partial;
+    partial.archive = std::move(archive);
+    const std::string& path = partial.archive->path();
+
+    // The directory mapping only lives while parsing
+    CentralDirectory cd(partial.archive->fd(), path);
+
+    uint64_t parts = std::min<uint64_t>(threads, cd.num_entries() / kMinRangeEntries);
+    uint64_t parsed = 0;
+
+    if (parts <= 1) {
+        partial.entry_storage.reserve(cd.num_entries());
+        parsed = parse_range(cd, path, cd.begin(), UINT64_MAX, 0, partial);
+    } else {
+        // Giant archive: parse ranges of the directory side by side, each
+        // into its own name arena, then concatenate them in order
+        std::vector<DirectoryRange> ranges = cd.split(parts);
+        size_t num_ranges = ranges.size() - 1;
+        std::vector<PartialIndex> chunks(num_ranges);
+        std::vector<uint64_t> counts(num_ranges, 0);
+        std::vector<std::exception_ptr> errors(num_ranges);
+
+        std::vector<std::jthread> pool;
+        for (size_t r = 0; r < num_ranges; r++) {
+            pool.emplace_back([&, r]() {
+                try {
+                    chunks[r].entry_storage.reserve(ranges[r + 1].index - ranges[r].index);
+                    counts[r] = parse_range(cd, path, ranges[r].pos, ranges[r + 1].pos,
+                                            ranges[r].index, chunks[r]);
+                } catch (...) {
+                    errors[r] = std::current_exception();
+                }
+            });
+        }
+        pool.clear();
+        for (auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
 
-    zip_int64_t num_entries = zip_get_num_entries(za, 0);
+        size_t total_entries = 0;
+        size_t total_names = 0;
+        for (const auto& chunk : chunks) {
+            total_entries += chunk.entry_storage.size();
+            total_names += chunk.name_storage.size();
+        }
+        partial.entry_storage.reserve(total_entries);
+        partial.name_storage.reserve(total_names);
+
+        for (size_t r = 0; r < num_ranges; r++) {
+            uint64_t shift = partial.name_storage.size();
+            for (PartialEntry entry : chunks[r].entry_storage) {
+                entry.name_offset += shift;
+                partial.entry_storage.push_back(entry);
+            }
+            partial.name_storage.insert(partial.name_storage.end(),
+                                        chunks[r].name_storage.begin(), chunks[r].name_storage.end());
+            partial.skipped_dirs += chunks[r].skipped_dirs;
+            partial.skipped_invalid += chunks[r].skipped_invalid;
+            parsed += counts[r];
+            chunks[r] = PartialIndex();
+        }
+    }
 
-    size_t indexed_files = 0;
-    size_t skipped_dirs = 0;
-    size_t skipped_duplicates = 0;
-    size_t compressed_files = 0;
+    if (parsed != cd.num_entries()) {
+        throw std::runtime_error("Central directory entry count mismatch in " + path);
+    }
+    partial.use_storage();
+    return partial;
+}
+
+struct ZipEntryManagerImpl::BuildState {
+    struct Dir {
+        uint32_t parent;
+        std::string_view name;
+    };
+
+    struct File {
+        uint32_t dir;
+        uint32_t archive;           // Index into partials
+        uint64_t entry;             // Index into that archive's entries
+        std::string_view name;
+    };
+
+    struct DirKeyHash {
+        size_t operator()(const std::pair<uint32_t, std::string_view>& key) const {
+            return std::hash<std::string_view>()(key.second) * 31 + key.first;
+        }
+    };
 
-    for (zip_int64_t i = 0; i < num_entries; i++) {
-        struct zip_stat st;
-        zip_stat_init(&st);
+    // Kept until the index is frozen: the names above point into them
+    std::vector<PartialIndex> partials;
 
-        if (zip_stat_index(za, i, 0, &st) != 0) {
-            std::cerr << "Warning: Failed to stat entry " << i << " in " << path << std::endl;
-            continue;
+    std::vector<Dir> dirs = {Dir{0, std::string_view()}};    // dirs[0] is the root
+    std::unordered_map<std::pair<uint32_t, std::string_view>, uint32_t, DirKeyHash> dir_ids;
+    std::vector<File> files;
+};
+
+void ZipEntryManagerImpl::merge(PartialIndex&& partial, BuildState& state) {
+    archives_.push_back(std::move(partial.archive));
+    uint32_t archive = state.partials.size();
+    state.partials.push_back(std::move(partial));
+    const PartialIndex& part = state.partials.back();
+
+    for (size_t e = 0; e < part.num_entries; e++) {
+        const PartialEntry& entry = part.entries[e];
+        const char* name = part.names + entry.name_offset;
+
+        // Parse the path
+        PathSplit path_split(name, entry.name_len);
+        if (path_split.is_dir()) {
+            continue; // Skip directory entries
         }
 
-        if (!(st.valid & ZIP_STAT_NAME) || !(st.valid & ZIP_STAT_SIZE)) {
-            std::cerr << "Warning: Entry " << i << " missing required metadata" << std::endl;
+        const auto& segments = path_split.segments();
+        if (segments.empty()) {
             continue;
         }
 
-        const char* name = st.name;
-        size_t name_len = std::strlen(name);
+        // All segments except the last are directories
+        uint32_t dir = 0;
+        auto last = std::prev(segments.end());
+        for (auto it = segments.begin(); it != last; ++it) {
+            std::string_view dir_name(name + std::get<0>(*it), std::get<1>(*it) - std::get<0>(*it));
+            auto result = state.dir_ids.emplace(std::make_pair(dir, dir_name), state.dirs.size());
+            if (result.second) {
+                state.dirs.push_back({dir, dir_name});
+            }
+            dir = result.first->second;
+        }
 
-        // Skip directories (entries ending with '/')
-        if (name_len > 0 && name[name_len - 1] == '/') {
-            skipped_dirs++;
+        // Last segment is the file name; duplicates are resolved in freeze()
+        std::string_view file_name(name + std::get<0>(*last), std::get<1>(*last) - std::get<0>(*last));
+        state.files.push_back({dir, archive, e, file_name});
+    }
+}
+
+void ZipEntryManagerImpl::freeze(BuildState& state) {
+    const size_t num_dirs = state.dirs.size();
+
+    // Lay directories out breadth first so the children of each directory
+    // are adjacent, in name order
+    std::vector<uint32_t> by_parent(num_dirs - 1);
+    for (uint32_t d = 1; d < num_dirs; d++) {
+        by_parent[d - 1] = d;
+    }
+    std::sort(by_parent.begin(), by_parent.end(), [&](uint32_t a, uint32_t b) {
+        const auto& da = state.dirs[a];
+        const auto& db = state.dirs[b];
+        return da.parent != db.parent ? da.parent < db.parent : da.name < db.name;
+    });
+    std::vector<uint32_t> first_child(num_dirs + 1, by_parent.size());
+    for (size_t i = by_parent.size(); i-- > 0; ) {
+        first_child[state.dirs[by_parent[i]].parent] = i;
+    }
+
+    std::vector<uint32_t> order = {0};          // Position -> build id
+    std::vector<uint32_t> position(num_dirs);   // Build id -> position
+    std::vector<uint32_t> child_begin(num_dirs), child_count(num_dirs);
+    order.reserve(num_dirs);
+    for (size_t p = 0; p < order.size(); p++) {
+        uint32_t d = order[p];
+        position[d] = p;
+        child_begin[p] = order.size();
+        for (size_t i = first_child[d]; i < by_parent.size() && state.dirs[by_parent[i]].parent == d; i++) {
+            order.push_back(by_parent[i]);
+        }
+        child_count[p] = order.size() - child_begin[p];
+    }
+    std::vector<uint32_t>().swap(by_parent);
+    std::vector<uint32_t>().swap(first_child);
+
+    // Files by directory position, then name; on a tie the earlier archive
+    // (and within an archive the earlier entry) wins
+    auto& files = state.files;
+    std::sort(files.begin(), files.end(), [&](const BuildState::File& a, const BuildState::File& b) {
+        if (a.dir != b.dir) {
+            return position[a.dir] < position[b.dir];
+        }
+        if (a.name != b.name) {
+            return a.name < b.name;
+        }
+        return a.archive != b.archive ? a.archive < b.archive : a.entry < b.entry;
+    });
+
+    std::vector<size_t> indexed(state.partials.size(), 0);
+    std::vector<size_t> duplicates(state.partials.size(), 0);
+    std::vector<size_t> compressed(state.partials.size(), 0);
+
+    size_t kept = 0;
+    size_t names_size = 1;
+    for (size_t d = 0; d < num_dirs; d++) {
+        names_size += state.dirs[d].name.size() + 1;
+    }
+    for (size_t i = 0; i < files.size(); i++) {
+        if (kept > 0 && files[kept - 1].dir == files[i].dir && files[kept - 1].name == files[i].name) {
+            // File already exists from earlier ZIP file, skip (first takes precedence)
+            duplicates[files[i].archive]++;
             continue;
         }
+        files[kept++] = files[i];
+        names_size += files[i].name.size() + 1;
+    }
+    files.resize(kept);
 
-        // Parse the path
-        PathSplit path_split(name, name_len);
+    // Ids share 31 bits with a kind flag in the path table, and entries
+    // refer to names by 32-bit offsets
+    if (kept >= kDirBit || num_dirs >= kDirBit) {
+        throw std::runtime_error("Too many files to index");
+    }
+    if (names_size > UINT32_MAX) {
+        throw std::runtime_error("File and directory names exceed 4 GiB");
+    }
 
-        if (path_split.is_dir()) {
-            skipped_dirs++;
-            continue; // Skip directory entries
+    // Copy everything into the final arrays
+    std::unique_ptr<char[]> names(new char[names_size]);
+    std::unique_ptr<DirectoryEntry[]> dirs(new DirectoryEntry[num_dirs]);
+    std::unique_ptr<FileEntry[]> file_entries(new FileEntry[kept]);
+    std::vector<CompressedInfo> compressed_info;
+
+    size_t name_pos = 0;
+    auto add_name = [&](std::string_view name) {
+        uint32_t offset = name_pos;
+        if (!name.empty()) {
+            std::memcpy(names.get() + name_pos, name.data(), name.size());
+        }
+        names[name_pos + name.size()] = '\0';
+        name_pos += name.size() + 1;
+        return offset;
+    };
+
+    for (size_t i = 0; i < kept; i++) {
+        const auto& file = files[i];
+        const PartialIndex& part = state.partials[file.archive];
+        const PartialEntry& entry = part.entries[file.entry];
+
+        FileEntry& fe = file_entries[i];
+        fe.name_ = add_name(file.name);
+        fe.name_len_ = file.name.size();
+        fe.parent_ = position[file.dir];
+        fe.size_lo_ = static_cast<uint32_t>(entry.size);
+        fe.size_hi_ = static_cast<uint16_t>(entry.size >> 32);
+        fe.zip_path_idx_ = file.archive;
+
+        // Encrypted entries must also go through libzip
+        if (entry.compression_method != ZIP_CM_STORE || entry.encrypted) {
+            if (compressed_info.size() > UINT32_MAX) {
+                throw std::runtime_error("Too many compressed entries");
+            }
+            if (entry.zip_index > UINT32_MAX) {
+                throw std::runtime_error("Too many entries in " + archives_[file.archive]->path());
+            }
+            fe.offset_lo_ = compressed_info.size();
+            fe.offset_hi_ = FileEntry::kCompressed;
+            compressed_info.push_back({entry.header_offset, entry.compressed_size, static_cast<uint32_t>(entry.zip_index),
+                                       entry.compression_method, entry.encrypted != 0, 0});
+            compressed[file.archive]++;
+        } else {
+            fe.offset_lo_ = static_cast<uint32_t>(entry.header_offset);
+            fe.offset_hi_ = static_cast<uint16_t>(entry.header_offset >> 32);
         }
+        indexed[file.archive]++;
+    }
 
-        // Navigate/create directory structure
-        DirectoryEntry* current_dir = &root_;
-        const auto& segments = path_split.segments();
+    size_t file_pos = 0;
+    for (size_t p = 0; p < num_dirs; p++) {
+        const auto& build = state.dirs[order[p]];
+        DirectoryEntry& de = dirs[p];
+        de.name_ = add_name(build.name);
+        de.name_len_ = build.name.size();
+        de.parent_ = p == 0 ? DirectoryEntry::kNoParent : position[build.parent];
+        de.first_dir_ = child_begin[p];
+        de.num_dirs_ = child_count[p];
+
+        de.first_file_ = file_pos;
+        while (file_pos < kept && position[files[file_pos].dir] == p) {
+            file_pos++;
+        }
+        de.num_files_ = file_pos - de.first_file_;
+    }
+    names[name_pos] = '\0';
 
-        auto it = segments.begin();
-        auto end = segments.end();
+    std::unique_ptr<CompressedInfo[]> compressed_table(new CompressedInfo[compressed_info.size()]);
+    std::copy(compressed_info.begin(), compressed_info.end(), compressed_table.get());
 
-        // All segments except the last are directories
-        if (it != end) {
-            auto last = std::prev(end);
-
-            for (; it != last; ++it) {
-                size_t start = std::get<0>(*it);
-                size_t finish = std::get<1>(*it);
-                std::string dir_name(name + start, finish - start);
-
-                // Check if directory already exists
-                auto dir_it = current_dir->dirs_.find(dir_name);
-                if (dir_it == current_dir->dirs_.end()) {
-                    // Create new directory
-                    auto new_dir = std::make_unique<DirectoryEntry>();
-                    new_dir->parent_ = current_dir;
-                    auto result = current_dir->dirs_.emplace(dir_name, std::move(new_dir));
-                    current_dir = result.first->second.get();
-                    // Store pointer to the key in the map for name_
-                    current_dir->name_ = &result.first->first;
-                } else {
-                    current_dir = dir_it->second.get();
-                }
+    storage_.clear();
+    names_ = keep(std::move(names));
+    names_size_ = names_size;
+    dirs_ = keep(std::move(dirs));
+    num_dirs_ = num_dirs;
+    files_ = keep(std::move(file_entries));
+    num_files_ = kept;
+    compressed_ = keep(std::move(compressed_table));
+    num_compressed_ = compressed_info.size();
+
+    build_path_table();
+
+    // Print indexing statistics
+    for (size_t k = 0; k < state.partials.size(); k++) {
+        std::cerr << "  Indexed: " << archives_[k]->path() << "\n";
+        std::cerr << "    Files indexed: " << indexed[k];
+        if (duplicates[k] > 0) {
+            std::cerr << ", Duplicates skipped: " << duplicates[k];
+        }
+        if (state.partials[k].skipped_invalid > 0) {
+            std::cerr << ", Invalid entries skipped: " << state.partials[k].skipped_invalid;
+        }
+        if (compressed[k] > 0) {
+            std::cerr << ", Compressed: " << compressed[k]
+                      << " (WARNING: Performance will be degraded. Use uncompressed ZIPs!)";
+        }
+        std::cerr << std::endl;
+    }
+}
+
+size_t ZipEntryManagerImpl::memory_used() const {
+    return names_size_ + num_dirs_ * sizeof(DirectoryEntry) + num_files_ * sizeof(FileEntry) +
+           num_compressed_ * sizeof(CompressedInfo) +
+           path_capacity_ * (sizeof(uint8_t) + sizeof(uint32_t)) +
+           (listing_order_ ? num_files_ * sizeof(uint32_t) : 0);
+}
+
+void ZipEntryManagerImpl::sort_listings_by_offset() {
+    std::unique_ptr<uint32_t[]> order(new uint32_t[num_files_]);
+
+    for (size_t d = 0; d < num_dirs_; d++) {
+        const DirectoryEntry& dir = dirs_[d];
+        if (dir.num_files_ == 0) {
+            continue;
+        }
+
+        uint32_t first = dir.first_file_;
+        uint32_t* begin = order.get() + first;
+        uint32_t* end = begin + dir.num_files_;
+        for (uint32_t* it = begin; it != end; it++) {
+            *it = first + (it - begin);
+        }
+        std::sort(begin, end, [this](uint32_t a, uint32_t b) {
+            const FileEntry& fa = files_[a];
+            const FileEntry& fb = files_[b];
+            if (fa.zip_path_idx_ != fb.zip_path_idx_) {
+                return fa.zip_path_idx_ < fb.zip_path_idx_;
             }
+            return fa.header_offset(compressed_) < fb.header_offset(compressed_);
+        });
+    }
 
-            // Last segment is the file name
-            size_t start = std::get<0>(*last);
-            size_t finish = std::get<1>(*last);
-            std::string file_name(name + start, finish - start);
+    listing_order_ = keep(std::move(order));
+}
 
-            // Check if file already exists (from a previous ZIP file)
-            if (current_dir->files_.find(file_name) != current_dir->files_.end()) {
-                // File already exists from earlier ZIP file, skip (first takes precedence)
-                skipped_duplicates++;
-                continue;
+void ZipEntryManagerImpl::build_path_table() {
+    // Load factor of 3/4 whatever the number of entries: 6.7 bytes of
+    // slots per entry, and probes mostly read the tags, a run of which
+    // fits in a cache line
+    size_t entries = num_dirs_ + num_files_;
+    size_t capacity = entries + entries / 3 + 1;
+    std::unique_ptr<uint8_t[]> tags(new uint8_t[capacity]());
+    std::unique_ptr<uint32_t[]> refs(new uint32_t[capacity]);
+
+    auto insert = [&](uint64_t hash, uint32_t ref) {
+        size_t slot = path_slot(hash, capacity);
+        while (tags[slot] != 0) {
+            slot = slot + 1 < capacity ? slot + 1 : 0;
+        }
+        tags[slot] = path_tag(hash);
+        refs[slot] = ref;
+    };
+
+    // Full paths of directories, without the leading '/'; the root is ""
+    // and is never looked up through the table
+    std::vector<std::string> dir_paths(num_dirs_);
+    std::string path;
+    for (size_t d = 0; d < num_dirs_; d++) {
+        const DirectoryEntry& dir = dirs_[d];
+        if (d > 0) {
+            const std::string& parent = dir_paths[dir.parent_];
+            std::string_view name(&names_[dir.name_], dir.name_len_);
+            dir_paths[d] = parent.empty() ? std::string(name) : parent + "/" + std::string(name);
+            insert(hash_bytes(dir_paths[d].data(), dir_paths[d].size()), d | kDirBit);
+        }
+
+        for (uint32_t f = dir.first_file_; f < dir.first_file_ + dir.num_files_; f++) {
+            path = dir_paths[d];
+            if (!path.empty()) {
+                path += '/';
+            }
+            path.append(&names_[files_[f].name_], files_[f].name_len_);
+            insert(hash_bytes(path.data(), path.size()), f);
+        }
+    }
+
+    path_tags_ = keep(std::move(tags));
+    path_refs_ = keep(std::move(refs));
+    path_capacity_ = capacity;
+}
+
+FrozenIndex ZipEntryManagerImpl::frozen() const {
+    return {names_, names_size_, dirs_, num_dirs_, files_, num_files_, compressed_, num_compressed_,
+            path_tags_, path_refs_, path_capacity_, listing_order_};
+}
+
+bool ZipEntryManagerImpl::consistent(const FrozenIndex& index,
+                                     const std::vector<std::unique_ptr<Archive>>& archives) const {
+    // Whatever the snapshot holds, lookups must stay inside the arrays,
+    // parent chains must end at the root and reads inside the archives
+    auto name_ok = [&](uint32_t offset, size_t len) {
+        return offset < index.names_size && len < index.names_size - offset && index.names[offset + len] == '\0';
+    };
+    auto run_ok = [](uint32_t first, uint32_t count, size_t size) {
+        return first <= size && count <= size - first;
+    };
+
+    if (index.num_dirs == 0 || index.num_dirs >= kDirBit || index.num_files >= kDirBit ||
+        index.num_compressed > UINT32_MAX) {
+        return false;
+    }
+    for (size_t d = 0; d < index.num_dirs; d++) {
+        const DirectoryEntry& dir = index.dirs[d];
+        // Parents come before their children, so a chain cannot loop
+        bool parent_ok = d == 0 ? dir.parent_ == DirectoryEntry::kNoParent : dir.parent_ < d;
+        if (!parent_ok || !name_ok(dir.name_, dir.name_len_) ||
+            !run_ok(dir.first_dir_, dir.num_dirs_, index.num_dirs) ||
+            !run_ok(dir.first_file_, dir.num_files_, index.num_files)) {
+            return false;
+        }
+    }
+    for (size_t f = 0; f < index.num_files; f++) {
+        const FileEntry& file = index.files[f];
+        if (!name_ok(file.name_, file.name_len_) || file.parent_ >= index.num_dirs ||
+            file.zip_path_idx_ >= archives.size() ||
+            (file.need_decompression() && file.offset_lo_ >= index.num_compressed)) {
+            return false;
+        }
+        // Checked the way parse_range() does; open() checks the rest
+        uint64_t header = file.header_offset(index.compressed);
+        uint64_t stored = file.need_decompression() ? index.compressed[file.offset_lo_].compressed_size : file.size();
+        uint64_t archive_size = archives[file.zip_path_idx_]->size();
+        uint64_t available = archive_size - std::min(archive_size, header);
+        if (available < kLocalHeaderSize || stored > available - kLocalHeaderSize) {
+            return false;
+        }
+    }
+
+    // Probes stop at an empty slot, so there must be one
+    size_t capacity = index.path_capacity;
+    if (capacity == 0) {
+        return false;
+    }
+    size_t empty = 0;
+    for (size_t slot = 0; slot < capacity; slot++) {
+        uint32_t ref = index.path_refs[slot];
+        if (index.path_tags[slot] == 0) {
+            empty++;
+        } else if ((ref & kDirBit) ? (ref & ~kDirBit) >= index.num_dirs : ref >= index.num_files) {
+            return false;
+        }
+    }
+    if (empty == 0) {
+        return false;
+    }
+
+    if (index.listing_order) {
+        for (size_t i = 0; i < index.num_files; i++) {
+            if (index.listing_order[i] >= index.num_files) {
+                return false;
             }
+        }
+    }
+    return true;
+}
+
+bool ZipEntryManagerImpl::use_snapshot(std::shared_ptr<const IndexSnapshot> snapshot,
+                                       std::vector<std::unique_ptr<Archive>>& archives) {
+    if (!snapshot || !consistent(snapshot->index(), archives)) {
+        return false;
+    }
+
+    const FrozenIndex& index = snapshot->index();
+    names_ = index.names;
+    names_size_ = index.names_size;
+    dirs_ = index.dirs;
+    num_dirs_ = index.num_dirs;
+    files_ = index.files;
+    num_files_ = index.num_files;
+    compressed_ = index.compressed;
+    num_compressed_ = index.num_compressed;
+    path_tags_ = index.path_tags;
+    path_refs_ = index.path_refs;
+    path_capacity_ = index.path_capacity;
+    listing_order_ = index.listing_order;
+
+    storage_.clear();
+    snapshot_ = std::move(snapshot);
+    archives_ = std::move(archives);
+    return true;
+}
 
-            // Create file entry
-            auto file_entry = std::make_unique<FileEntry>();
-            file_entry->parent_ = current_dir;
-            file_entry->zip_path_idx_ = zip_idx;
-            file_entry->size_ = st.size;
-            file_entry->compressed_size_ = st.comp_size;
-
-            // Get compression method
-            zip_uint16_t comp_method = 0;
-            if (st.valid & ZIP_STAT_COMP_METHOD) {
-                comp_method = st.comp_method;
+bool ZipEntryManagerImpl::matches(const DirectoryEntry* dir, const char* path, size_t len) const {
+    // Compare from the last component back to the root
+    while (dir->parent_ != DirectoryEntry::kNoParent) {
+        size_t name_len = dir->name_len_;
+        if (name_len > len || std::memcmp(path + len - name_len, &names_[dir->name_], name_len) != 0) {
+            return false;
+        }
+        len -= name_len;
+        dir = &dirs_[dir->parent_];
+        if (dir->parent_ != DirectoryEntry::kNoParent) {
+            if (len == 0 || path[len - 1] != '/') {
+                return false;
             }
-            file_entry->need_decompression_ = (comp_method != ZIP_CM_STORE);
+            len--;
+        }
+    }
+    return len == 0;
+}
+
+uint32_t ZipEntryManagerImpl::find_path(const char* path, size_t len, bool dir) const {
+    uint64_t hash = hash_bytes(path, len);
+    uint8_t tag = path_tag(hash);
 
-            // Track compressed files
-            if (file_entry->need_decompression_) {
-                compressed_files++;
+    for (size_t slot = path_slot(hash, path_capacity_); path_tags_[slot] != 0;
+         slot = slot + 1 < path_capacity_ ? slot + 1 : 0) {
+        uint32_t ref = path_refs_[slot];
+        if (path_tags_[slot] != tag || ((ref & kDirBit) != 0) != dir) {
+            continue;
+        }
+
+        uint32_t id = ref & ~kDirBit;
+        if (dir) {
+            if (matches(&dirs_[id], path, len)) {
+                return id;
             }
+            continue;
+        }
 
-            // Get local header offset
-            if (st.valid & ZIP_STAT_COMP_SIZE) {
-                // We need to calculate the actual data offset
-                // For now, store the index; we'll resolve offset on read
-                file_entry->offset_ = i;
-            } else {
-                file_entry->offset_ = 0;
+        const FileEntry* file = &files_[id];
+        size_t name_len = file->name_len_;
+        if (name_len > len || std::memcmp(path + len - name_len, &names_[file->name_], name_len) != 0) {
+            continue;
+        }
+        size_t rest = len - name_len;
+        const DirectoryEntry* parent = &dirs_[file->parent_];
+        if (parent->parent_ != DirectoryEntry::kNoParent) {
+            if (rest == 0 || path[rest - 1] != '/') {
+                continue;
             }
+            rest--;
+        }
+        if (matches(parent, path, rest)) {
+            return id;
+        }
+    }
+    return kNotFound;
+}
+
+void ZipEntryManagerImpl::index_zipfiles(const std::vector<std::filesystem::path>& paths, unsigned threads) {
+    if (!archives_.empty()) {
+        throw std::logic_error("The index is already built");
+    }
+    // FileEntry keeps the archive index in 16 bits
+    if (paths.size() > UINT16_MAX + 1u) {
+        throw std::runtime_error("Too many ZIP files (at most 65536)");
+    }
 
-            // Insert file entry
-            auto result = current_dir->files_.emplace(file_name, std::move(file_entry));
-            // Store pointer to the key in the map for name_
-            result.first->second->name_ = &result.first->first;
-            indexed_files++;
+    // Convert to absolute paths to handle relative paths
+    std::vector<std::unique_ptr<Archive>> archives(paths.size());
+    auto open_archive = [&](size_t k) {
+        if (!archives[k]) {
+            archives[k] = std::make_unique<Archive>(std::filesystem::absolute(paths[k]).string(), k);
         }
+    };
+
+    // A snapshot of the same archives replaces the whole build. Checking
+    // it reads every central directory, so that is done in parallel.
+    std::vector<SnapshotKey> keys;
+    std::filesystem::path snapshot_file;
+    if (!index_cache_.empty()) {
+        keys.resize(paths.size());
+        for_each_parallel(paths.size(), threads, [&](size_t k) {
+            open_archive(k);
+            keys[k] = IndexSnapshot::key_for(*archives[k]);
+        });
+        snapshot_file = IndexSnapshot::file_for(index_cache_, keys, listing_by_offset_);
     }
 
-    zip_close(za);
+    if (!snapshot_file.empty() &&
+        use_snapshot(IndexSnapshot::load(snapshot_file, keys, listing_by_offset_), archives)) {
+        for (const auto& archive : archives_) {
+            std::cerr << "  Indexed: " << archive->path() << " (from snapshot)" << std::endl;
+        }
+    } else {
+        build(archives, open_archive, threads);
+        if (listing_by_offset_) {
+            sort_listings_by_offset();
+        }
+        if (!snapshot_file.empty() && !IndexSnapshot::save(snapshot_file, keys, frozen())) {
+            std::cerr << "Warning: Failed to write index snapshot " << snapshot_file << std::endl;
+        }
+    }
 
-    // Print indexing statistics
-    std::cerr << "    Files indexed: " << indexed_files;
-    if (skipped_duplicates > 0) {
-        std::cerr << ", Duplicates skipped: " << skipped_duplicates;
+    std::cerr << "Index: " << num_files_ << " files, " << num_dirs_ << " directories, "
+              << (memory_used() >> 10) << " KiB" << std::endl;
+}
+
+void ZipEntryManagerImpl::build(std::vector<std::unique_ptr<Archive>>& archives,
+                                const std::function<void(size_t)>& open_archive, unsigned threads) {
+    size_t count = archives.size();
+    BuildState state;
+
+    std::vector<PartialIndex> partials(count);
+    std::vector<std::exception_ptr> errors(count);
+    std::vector<bool> done(count, false);
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<size_t> next(0);
+
+    // Threads left over when there are fewer archives than threads go to
+    // splitting each archive's directory
+    unsigned per_archive = std::max<size_t>(1, threads / std::max<size_t>(1, std::min<size_t>(threads, count)));
+
+    // Archives are parsed in any order but merged strictly in argument
+    // order, so the first archive still wins every duplicate
+    auto worker = [&]() {
+        for (size_t k = next++; k < count; k = next++) {
+            try {
+                open_archive(k);
+                partials[k] = parse_archive(std::move(archives[k]), per_archive);
+            } catch (...) {
+                errors[k] = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            done[k] = true;
+            cv.notify_all();
+        }
+    };
+
+    // Joined on every way out of here, including a throw below
+    std::vector<std::jthread> pool;
+    std::exception_ptr error;
+    try {
+        threads = std::max<size_t>(1, std::min<size_t>(threads, count));
+        for (unsigned t = 0; t < threads; t++) {
+            pool.emplace_back(worker);
+        }
+
+        for (size_t k = 0; k < count; k++) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return done[k]; });
+            }
+            if (errors[k]) {
+                std::rethrow_exception(errors[k]);
+            }
+            merge(std::move(partials[k]), state);
+        }
+    } catch (...) {
+        error = std::current_exception();
+        next = count;   // Stop handing out archives
     }
-    if (compressed_files > 0) {
-        std::cerr << ", Compressed: " << compressed_files
-                  << " (WARNING: Performance will be degraded. Use uncompressed ZIPs!)";
+
+    pool.clear();
+    if (error) {
+        std::rethrow_exception(error);
     }
-    std::cerr << std::endl;
+
+    freeze(state);
+}
+
+size_t FileEntry::zip_index() const {
+    return need_decompression() ? ZipEntryManager::get_instance().compressed_info(offset_lo_).zip_index : SIZE_MAX;
 }
 
-const DirectoryEntry* DirectoryEntry::find_dir(const std::string& name) const {
-    auto it = dirs_.find(name);
-    if (it != dirs_.end()) {
-        return it->second.get();
+size_t FileEntry::compressed_size() const {
+    return need_decompression() ? ZipEntryManager::get_instance().compressed_info(offset_lo_).compressed_size : size();
+}
+
+uint16_t FileEntry::compression_method() const {
+    return need_decompression() ? ZipEntryManager::get_instance().compressed_info(offset_lo_).compression_method
+                                : ZIP_CM_STORE;
+}
+
+bool FileEntry::encrypted() const {
+    return need_decompression() && ZipEntryManager::get_instance().compressed_info(offset_lo_).encrypted;
+}
+
+const DirectoryEntry* DirectoryEntry::find_dir(std::string_view name) const {
+    // Resolve the arrays once, not through the singleton per comparison
+    const ZipEntryManagerImpl& index = ZipEntryManager::get_instance();
+    const char* names = index.name_at(0);
+    const DirectoryEntry* first = index.dir_at(first_dir_);
+    const DirectoryEntry* last = first + num_dirs_;
+    auto it = std::lower_bound(first, last, name,
+        [names](const DirectoryEntry& d, std::string_view n) { return d.name(names) < n; });
+    if (it != last && it->name(names) == name) {
+        return it;
     }
     return nullptr;
 }
 
-const FileEntry* DirectoryEntry::find_file(const std::string& name) const {
-    auto it = files_.find(name);
-    if (it != files_.end()) {
-        return it->second.get();
+const FileEntry* DirectoryEntry::find_file(std::string_view name) const {
+    const ZipEntryManagerImpl& index = ZipEntryManager::get_instance();
+    const char* names = index.name_at(0);
+    const FileEntry* first = index.file_at(first_file_);
+    const FileEntry* last = first + num_files_;
+    auto it = std::lower_bound(first, last, name,
+        [names](const FileEntry& f, std::string_view n) { return f.name(names) < n; });
+    if (it != last && it->name(names) == name) {
+        return it;
     }
     return nullptr;
 }
 
+namespace {
+
+// Whether `path` is "/" followed by non-empty components other than "."
+// and "..", separated by single slashes, with no trailing slash. FUSE
+// passes paths in this form.
+bool is_canonical(const char* path, size_t len) {
+    if (len < 2 || path[0] != '/' || path[len - 1] == '/') {
+        return false;
+    }
+    size_t start = 1;
+    for (size_t i = 1; i <= len; i++) {
+        if (i == len || path[i] == '/') {
+            size_t seg = i - start;
+            if (seg == 0 || (seg == 1 && path[start] == '.') ||
+                (seg == 2 && path[start] == '.' && path[start + 1] == '.')) {
+                return false;
+            }
+            start = i + 1;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
 const DirectoryEntry* ZipEntryManagerImpl::lookup_dir(const char* path) const {
+    size_t len = std::strlen(path);
+    if (path_tags_ && is_canonical(path, len)) {
+        uint32_t id = find_path(path + 1, len - 1, true);
+        return id == kNotFound ? nullptr : &dirs_[id];
+    }
+    return walk_dir(path);
+}
+
+const FileEntry* ZipEntryManagerImpl::lookup_file(const char* path) const {
+    size_t len = std::strlen(path);
+    if (path_tags_ && is_canonical(path, len)) {
+        uint32_t id = find_path(path + 1, len - 1, false);
+        return id == kNotFound ? nullptr : &files_[id];
+    }
+    return walk_file(path);
+}
+
+const DirectoryEntry* ZipEntryManagerImpl::walk_dir(const char* path) const {
     if (path[0] == '\0' || (path[0] == '/' && path[1] == '\0')) {
-        return &root_;
+        return &root();
     }
 
     PathSplit path_split(path, std::strlen(path));
     const auto& segments = path_split.segments();
 
-    const DirectoryEntry* current_dir = &root_;
+    const DirectoryEntry* current_dir = &root();
 
     for (const auto& seg : segments) {
         size_t start = std::get<0>(seg);
         size_t finish = std::get<1>(seg);
-        std::string name(path + start, finish - start);
 
-        current_dir = current_dir->find_dir(name);
+        current_dir = current_dir->find_dir(std::string_view(path + start, finish - start));
         if (!current_dir) {
             return nullptr;
         }
@@ -201,7 +902,7 @@ const DirectoryEntry* ZipEntryManagerImpl::lookup_dir(const char* path) const {
     return current_dir;
 }
 
-const FileEntry* ZipEntryManagerImpl::lookup_file(const char* path) const {
+const FileEntry* ZipEntryManagerImpl::walk_file(const char* path) const {
     if (path[0] == '\0') {
         return nullptr;
     }
@@ -218,7 +919,7 @@ const FileEntry* ZipEntryManagerImpl::lookup_file(const char* path) const {
         return nullptr;
     }
 
-    const DirectoryEntry* current_dir = &root_;
+    const DirectoryEntry* current_dir = &root();
     auto it = segments.begin();
     auto end = segments.end();
     auto last = std::prev(end);
@@ -227,9 +928,8 @@ const FileEntry* ZipEntryManagerImpl::lookup_file(const char* path) const {
     for (; it != last; ++it) {
         size_t start = std::get<0>(*it);
         size_t finish = std::get<1>(*it);
-        std::string name(path + start, finish - start);
 
-        current_dir = current_dir->find_dir(name);
+        current_dir = current_dir->find_dir(std::string_view(path + start, finish - start));
         if (!current_dir) {
             return nullptr;
         }
@@ -238,9 +938,8 @@ const FileEntry* ZipEntryManagerImpl::lookup_file(const char* path) const {
     // Look up the file in the final directory
     size_t start = std::get<0>(*last);
     size_t finish = std::get<1>(*last);
-    std::string file_name(path + start, finish - start);
 
-    return current_dir->find_file(file_name);
+    return current_dir->find_file(std::string_view(path + start, finish - start));
 }
 
 } // namespace scalable_zip_fs
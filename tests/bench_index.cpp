@@ -0,0 +1,192 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "zipdir.hpp"
+
+using scalable_zip_fs::CentralDirectory;
+using scalable_zip_fs::CentralRecord;
+using scalable_zip_fs::kLocalHeaderSize;
+using scalable_zip_fs::local_header_length;
+
+// One entry per 4 KiB page, so every local header is on a page of its own
+// as it would be in an archive of real files
+static const uint64_t kSpacing = 4096;
+
+static void put16(std::vector<unsigned char>& out, uint16_t v) {
+    out.push_back(v & 0xFF);
+    out.push_back(v >> 8);
+}
+
+static void put32(std::vector<unsigned char>& out, uint32_t v) {
+    put16(out, v & 0xFFFF);
+    put16(out, v >> 16);
+}
+
+static void put64(std::vector<unsigned char>& out, uint64_t v) {
+    put32(out, v & 0xFFFFFFFF);
+    put32(out, v >> 32);
+}
+
+// Write a ZIP64 archive of `count` stored entries to `fd`. Only the headers
+// are written; the data between them is left as holes.
+static void write_archive(int fd, uint64_t count) {
+    std::vector<unsigned char> cd;
+    std::vector<unsigned char> local;
+    char name[32];
+
+    for (uint64_t i = 0; i < count; i++) {
+        int name_len = std::snprintf(name, sizeof(name), "d%03u/f%07u.bin",
+                                     unsigned(i / 1000), unsigned(i));
+        uint64_t offset = i * kSpacing;
+        uint32_t size = kSpacing - kLocalHeaderSize - name_len;
+
+        local.clear();
+        put32(local, 0x04034b50);
+        put16(local, 20);
+        put16(local, 0);
+        put16(local, 0);
+        put32(local, 0);
+        put32(local, 0);
+        put32(local, size);
+        put32(local, size);
+        put16(local, name_len);
+        put16(local, 0);
+        local.insert(local.end(), name, name + name_len);
+        if (pwrite(fd, local.data(), local.size(), offset) != (ssize_t)local.size()) {
+            throw std::runtime_error("write failed");
+        }
+
+        put32(cd, 0x02014b50);
+        put16(cd, 20);
+        put16(cd, 20);
+        put16(cd, 0);
+        put16(cd, 0);
+        put32(cd, 0);
+        put32(cd, 0);
+        put32(cd, size);
+        put32(cd, size);
+        put16(cd, name_len);
+        put16(cd, 0);
+        put16(cd, 0);
+        put16(cd, 0);
+        put16(cd, 0);
+        put32(cd, 0);
+        put32(cd, offset);
+        cd.insert(cd.end(), name, name + name_len);
+    }
+
+    uint64_t cd_offset = count * kSpacing;
+    uint64_t eocd64_offset = cd_offset + cd.size();
+    uint64_t cd_size = cd.size();
+
+    put32(cd, 0x06064b50);
+    put64(cd, 44);
+    put16(cd, 45);
+    put16(cd, 45);
+    put32(cd, 0);
+    put32(cd, 0);
+    put64(cd, count);
+    put64(cd, count);
+    put64(cd, cd_size);
+    put64(cd, cd_offset);
+
+    put32(cd, 0x07064b50);
+    put32(cd, 0);
+    put64(cd, eocd64_offset);
+    put32(cd, 1);
+
+    put32(cd, 0x06054b50);
+    put16(cd, 0);
+    put16(cd, 0);
+    put16(cd, 0xFFFF);
+    put16(cd, 0xFFFF);
+    put32(cd, 0xFFFFFFFF);
+    put32(cd, 0xFFFFFFFF);
+    put16(cd, 0);
+
+    if (pwrite(fd, cd.data(), cd.size(), cd_offset) != (ssize_t)cd.size()) {
+        throw std::runtime_error("write failed");
+    }
+}
+
+static long faults() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+// Walk the central directory of a cold archive, also reading every local
+// header if `headers`, the way indexing used to resolve data offsets
+static void run(int fd, const std::string& path, bool headers) {
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    long faults_before = faults();
+    auto start = std::chrono::steady_clock::now();
+
+    uint64_t checksum = 0;
+    uint64_t entries = 0;
+    {
+        CentralDirectory cd(fd, path);
+        const unsigned char* map = nullptr;
+        if (headers) {
+            void* p = mmap(nullptr, cd.archive_size(), PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                throw std::runtime_error("mmap failed");
+            }
+            map = static_cast<const unsigned char*>(p);
+        }
+
+        CentralRecord rec;
+        for (uint64_t pos = cd.begin(); cd.next(pos, rec); entries++) {
+            checksum += rec.size + rec.name_len;
+            if (headers) {
+                checksum += local_header_length(map + rec.local_header_offset);
+            }
+        }
+
+        if (map) {
+            munmap(const_cast<unsigned char*>(map), cd.archive_size());
+        }
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double ms = std::chrono::duration<double, std::milli>(elapsed).count();
+    std::printf("%-30s %8.1f ms, %8ld page faults, %zu entries (checksum %zu)\n",
+                headers ? "Directory and local headers:" : "Directory only:",
+                ms, faults() - faults_before, (size_t)entries, (size_t)checksum);
+}
+
+int main(int argc, char** argv) {
+    uint64_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    std::string path = argc > 2 ? argv[2] : "bench_index.zip";
+
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::perror(path.c_str());
+        return 1;
+    }
+
+    int status = 0;
+    try {
+        write_archive(fd, count);
+        run(fd, path, false);
+        run(fd, path, true);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        status = 1;
+    }
+
+    close(fd);
+    unlink(path.c_str());
+    return status;
+}
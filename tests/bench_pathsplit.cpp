@@ -0,0 +1,63 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "utils.hpp"
+
+using scalable_zip_fs::PathSplit;
+
+// Every heap allocation in the process goes through here
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+int main() {
+    static const char* const paths[] = {
+        "a",
+        "/data/train/shard-00017/sample_000123.jpg",
+        "images/2024/05/17/camera-front/frame_000000000042.png",
+        "./a/./b/../c//d/",
+        "very/long/directory/name/with/many/components/that/go/on/and/on/file.txt",
+        "a/b/c/d/e/f/g/h/i/j/k/l/m/n/o/p/q/r/s/t/u/v/w/x/y/z/0/1/2/3/4",
+    };
+    const size_t num_paths = sizeof(paths) / sizeof(paths[0]);
+    size_t lengths[num_paths];
+    for (size_t i = 0; i < num_paths; i++) {
+        lengths[i] = std::strlen(paths[i]);
+    }
+
+    const size_t rounds = 2000000;
+    size_t checksum = 0;
+    size_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t r = 0; r < rounds; r++) {
+        size_t i = r % num_paths;
+        PathSplit split(paths[i], lengths[i]);
+        checksum += split.segments().size() + split.is_dir();
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    size_t allocated = allocations - before;
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / rounds;
+
+    std::printf("PathSplit: %.1f ns/call, %zu allocations in %zu calls (checksum %zu)\n",
+                ns, allocated, rounds, checksum);
+    return allocated == 0 ? 0 : 1;
+}
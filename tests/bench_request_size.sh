@@ -0,0 +1,88 @@
+#!/bin/bash
+# Benchmark: sequential read throughput with 128 KiB vs 1 MiB FUSE requests
+#
+# Mounts one large stored entry with each max_request_kb setting and times
+# a streaming read of it. The archive is read once beforehand so both runs
+# are served from the page cache and only per-request overhead differs.
+#
+# Usage: tests/bench_request_size.sh [size_mb] [runs]
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_DIR="$(dirname "$SCRIPT_DIR")"
+BUILD_DIR="$PROJECT_DIR/build"
+TEST_DIR="/tmp/scalable-zip-fs-bench"
+MOUNT_POINT="$TEST_DIR/mount"
+
+SIZE_MB="${1:-2048}"
+RUNS="${2:-3}"
+
+# Colors for output
+YELLOW='\033[1;33m'
+NC='\033[0m' # No Color
+
+setup() {
+    rm -rf "$TEST_DIR"
+    mkdir -p "$MOUNT_POINT"
+    cd "$TEST_DIR"
+
+    echo "Creating ${SIZE_MB} MiB stored sample..."
+    dd if=/dev/urandom of=sample.bin bs=1M count="$SIZE_MB" status=none
+    zip -0 bench.zip sample.bin >/dev/null
+    rm -f sample.bin
+    cat bench.zip > /dev/null
+}
+
+cleanup() {
+    fusermount -u "$MOUNT_POINT" 2>/dev/null || true
+    cd /
+    rm -rf "$TEST_DIR"
+}
+
+# Print MiB/s for one full read of the sample
+read_once() {
+    local start=$(date +%s%N)
+    dd if="$MOUNT_POINT/sample.bin" of=/dev/null bs=4M status=none
+    local end=$(date +%s%N)
+    echo $((SIZE_MB * 1000000000 / (end - start)))
+}
+
+bench() {
+    local request_kb="$1"
+    echo -e "${YELLOW}max_request_kb=$request_kb${NC}"
+
+    local best=0
+    for i in $(seq 1 "$RUNS"); do
+        # A fresh mount per run, so nothing is left in the FUSE page cache
+        "$BUILD_DIR/scalable-zip-fs" bench.zip "$MOUNT_POINT" -f -o max_request_kb="$request_kb" 2>/dev/null &
+        local pid=$!
+        sleep 2
+
+        local rate=$(read_once)
+        echo "  run $i: ${rate} MiB/s"
+        if [ "$rate" -gt "$best" ]; then
+            best=$rate
+        fi
+
+        fusermount -u "$MOUNT_POINT"
+        wait $pid 2>/dev/null || true
+    done
+
+    echo "  best: ${best} MiB/s"
+}
+
+main() {
+    if [ ! -f "$BUILD_DIR/scalable-zip-fs" ]; then
+        echo "Error: scalable-zip-fs not built. Run 'meson compile -C build' first."
+        exit 1
+    fi
+
+    trap cleanup EXIT
+    setup
+
+    bench 128
+    bench 1024
+}
+
+main "$@"
@@ -21,6 +21,10 @@ TESTS_RUN=0
 TESTS_PASSED=0
 TESTS_FAILED=0
 
+# Frontend under test and the mount options selecting it (see main)
+FRONTEND=""
+FRONTEND_OPTS=()
+
 # Setup
 setup() {
     echo "Setting up test environment..."
@@ -41,7 +45,17 @@ cleanup() {
 run_test() {
     local test_name="$1"
     TESTS_RUN=$((TESTS_RUN + 1))
-    echo -e "\n${YELLOW}[TEST $TESTS_RUN]${NC} $test_name"
+    echo -e "\n${YELLOW}[TEST $TESTS_RUN]${NC} $test_name ($FRONTEND)"
+}
+
+# Mount through the path based API, or with -o lowlevel through the inode
+# based one
+use_frontend() {
+    FRONTEND="$1"
+    case "$FRONTEND" in
+        highlevel) FRONTEND_OPTS=() ;;
+        lowlevel)  FRONTEND_OPTS=(-o lowlevel) ;;
+    esac
 }
 
 pass_test() {
@@ -96,7 +110,7 @@ test_mount_single_zip() {
     zip -q test.zip testdata/file.txt
 
     # Mount
-    "$BUILD_DIR/scalable-zip-fs" test.zip "$MOUNT_POINT" -f &
+    "$BUILD_DIR/scalable-zip-fs" test.zip "$MOUNT_POINT" -f "${FRONTEND_OPTS[@]}" &
     local pid=$!
     sleep 2
 
@@ -130,7 +144,7 @@ test_readonly_enforcement() {
     zip -q test.zip testdata/file.txt
 
     # Mount
-    "$BUILD_DIR/scalable-zip-fs" test.zip "$MOUNT_POINT" -f &
+    "$BUILD_DIR/scalable-zip-fs" test.zip "$MOUNT_POINT" -f "${FRONTEND_OPTS[@]}" &
     local pid=$!
     sleep 2
 
@@ -160,7 +174,7 @@ test_directory_traversal() {
     zip -q -r test.zip testdata/
 
     # Mount
-    "$BUILD_DIR/scalable-zip-fs" test.zip "$MOUNT_POINT" -f &
+    "$BUILD_DIR/scalable-zip-fs" test.zip "$MOUNT_POINT" -f "${FRONTEND_OPTS[@]}" &
     local pid=$!
     sleep 2
 
@@ -191,7 +205,7 @@ test_empty_files() {
     touch testdata/empty.txt
     zip -q test.zip testdata/empty.txt
 
-    "$BUILD_DIR/scalable-zip-fs" test.zip "$MOUNT_POINT" -f &
+    "$BUILD_DIR/scalable-zip-fs" test.zip "$MOUNT_POINT" -f "${FRONTEND_OPTS[@]}" &
     local pid=$!
     sleep 2
 
@@ -223,7 +237,7 @@ test_large_files() {
     local original_md5=$(md5sum testdata/large.bin | cut -d' ' -f1)
     zip -q -0 test.zip testdata/large.bin
 
-    "$BUILD_DIR/scalable-zip-fs" test.zip "$MOUNT_POINT" -f &
+    "$BUILD_DIR/scalable-zip-fs" test.zip "$MOUNT_POINT" -f "${FRONTEND_OPTS[@]}" &
     local pid=$!
     sleep 2
 
@@ -251,7 +265,7 @@ test_special_characters() {
     echo "test" > "testdata/file_with_underscores.txt"
     zip -q test.zip testdata/*
 
-    "$BUILD_DIR/scalable-zip-fs" test.zip "$MOUNT_POINT" -f &
+    "$BUILD_DIR/scalable-zip-fs" test.zip "$MOUNT_POINT" -f "${FRONTEND_OPTS[@]}" &
     local pid=$!
     sleep 2
 
@@ -283,7 +297,7 @@ test_multi_archive() {
     zip -q zip1.zip data1/file1.txt
     zip -q zip2.zip data2/file2.txt
 
-    "$BUILD_DIR/scalable-zip-fs" zip1.zip zip2.zip "$MOUNT_POINT" -f &
+    "$BUILD_DIR/scalable-zip-fs" zip1.zip zip2.zip "$MOUNT_POINT" -f "${FRONTEND_OPTS[@]}" &
     local pid=$!
     sleep 2
 
@@ -314,7 +328,7 @@ test_file_precedence() {
     echo "second" > data/conflict.txt
     zip -q second.zip data/conflict.txt
 
-    "$BUILD_DIR/scalable-zip-fs" first.zip second.zip "$MOUNT_POINT" -f &
+    "$BUILD_DIR/scalable-zip-fs" first.zip second.zip "$MOUNT_POINT" -f "${FRONTEND_OPTS[@]}" &
     local pid=$!
     sleep 2
 
@@ -332,6 +346,210 @@ test_file_precedence() {
     rm -rf data first.zip second.zip
 }
 
+# Test 9: Directory larger than one readdir reply
+test_large_directory() {
+    run_test "Large directory listing (5000 entries)"
+
+    mkdir -p bigdir
+    local i
+    for i in $(seq -w 1 5000); do
+        : > "bigdir/entry-$i-of-a-large-directory.txt"
+    done
+    zip -q -r big.zip bigdir
+    local expected=$(ls -A bigdir | LC_ALL=C sort)
+
+    "$BUILD_DIR/scalable-zip-fs" big.zip "$MOUNT_POINT" -f "${FRONTEND_OPTS[@]}" &
+    local pid=$!
+    sleep 2
+
+    # ls -f keeps the order readdir returned, across all of its replies
+    local listing=$(ls -f "$MOUNT_POINT/bigdir" | grep -vx '\.\|\.\.')
+
+    fusermount -u "$MOUNT_POINT"
+    wait $pid 2>/dev/null || true
+
+    local duplicates=$(echo "$listing" | LC_ALL=C sort | uniq -d)
+    if [ -n "$duplicates" ]; then
+        fail_test "Entries listed more than once: $(echo "$duplicates" | head -3 | tr '\n' ' ')"
+    elif [ "$(echo "$listing" | LC_ALL=C sort)" != "$expected" ]; then
+        fail_test "Listing does not match the archive ($(echo "$listing" | wc -l) of 5000 entries)"
+    else
+        pass_test
+    fi
+
+    rm -rf bigdir big.zip
+}
+
+# Test 10: Reads at random offsets into deflated entries
+test_deflate_random_reads() {
+    run_test "Random reads from deflated files"
+
+    # Two entries of about 21 MB: at a 1 MB budget each keeps all of its
+    # checkpoints alone, but alternating reads evict and rebuild them
+    mkdir -p deflated
+    seq 1 3000000 > deflated/ascending.txt
+    seq 3000000 -1 1 > deflated/descending.txt
+    zip -q -9 -r deflated.zip deflated
+
+    local success=true
+    local budget_opts i file size offset length
+    for budget_opts in "" "inflate_index_mb=1,inflate_span_mb=1"; do
+        local extra_opts=()
+        [ -n "$budget_opts" ] && extra_opts=(-o "$budget_opts")
+
+        "$BUILD_DIR/scalable-zip-fs" deflated.zip "$MOUNT_POINT" -f "${FRONTEND_OPTS[@]}" "${extra_opts[@]}" &
+        local pid=$!
+        sleep 2
+
+        RANDOM=42
+        for i in $(seq 1 100); do
+            if [ $((i % 2)) -eq 0 ]; then
+                file=deflated/ascending.txt
+            else
+                file=deflated/descending.txt
+            fi
+            size=$(stat -c %s "$file")
+            offset=$(( ((RANDOM << 15) | RANDOM) % size ))
+            length=$(( 1 + RANDOM % 262144 ))
+
+            if [ "$(dd if="$MOUNT_POINT/$file" iflag=skip_bytes,count_bytes skip=$offset count=$length \
+                        bs=64K 2>/dev/null | md5sum)" != \
+                 "$(dd if="$file" iflag=skip_bytes,count_bytes skip=$offset count=$length \
+                        bs=64K 2>/dev/null | md5sum)" ]; then
+                echo "  Mismatch: $file at $offset+$length${budget_opts:+ ($budget_opts)}"
+                success=false
+            fi
+        done
+
+        fusermount -u "$MOUNT_POINT"
+        wait $pid 2>/dev/null || true
+    done
+
+    if [ "$success" = true ]; then
+        pass_test
+    else
+        fail_test "Random reads returned wrong data"
+    fi
+
+    rm -rf deflated deflated.zip
+}
+
+# Test 11: readdir_order=offset lists files in archive order
+test_offset_listing_order() {
+    run_test "Listing in archive order (readdir_order=offset)"
+
+    # Files go into the archive in the argument order, which is not name
+    # order; subdirectories are listed first, by name, in either mode
+    mkdir -p ordered/zdir ordered/adir cache
+    local name
+    for name in zeta.txt alpha.txt mid.txt beta.txt zdir/f.txt adir/f.txt; do
+        echo "$name" > "ordered/$name"
+    done
+    zip -q order.zip ordered/zeta.txt ordered/alpha.txt ordered/mid.txt ordered/zdir/f.txt \
+        ordered/beta.txt ordered/adir/f.txt
+    local by_name="adir alpha.txt beta.txt mid.txt zdir zeta.txt"
+    local by_offset="adir zdir zeta.txt alpha.txt mid.txt beta.txt"
+
+    local success=true
+    local order_opts round listing expected
+    # The second offset mount loads the snapshot written by the first; each
+    # mount lists three times, so the low-level frontend also serves the
+    # listing from its dirent cache
+    for order_opts in "" "readdir_order=offset,index_cache=cache" "readdir_order=offset,index_cache=cache"; do
+        local extra_opts=()
+        [ -n "$order_opts" ] && extra_opts=(-o "$order_opts")
+        expected="$by_offset"
+        [ -z "$order_opts" ] && expected="$by_name"
+
+        "$BUILD_DIR/scalable-zip-fs" order.zip "$MOUNT_POINT" -f "${FRONTEND_OPTS[@]}" "${extra_opts[@]}" \
+            2>order.log &
+        local pid=$!
+        sleep 2
+
+        for round in 1 2 3; do
+            listing=$(ls -f "$MOUNT_POINT/ordered" | grep -vx '\.\|\.\.' | tr '\n' ' ' | sed 's/ $//')
+            if [ "$listing" != "$expected" ]; then
+                echo "  Got '$listing', expected '$expected'${order_opts:+ ($order_opts)}"
+                success=false
+            fi
+        done
+
+        fusermount -u "$MOUNT_POINT"
+        wait $pid 2>/dev/null || true
+    done
+
+    # The last mount must have come from the snapshot for the round trip
+    # to count
+    if ! grep -q "from snapshot" order.log; then
+        echo "  Index snapshot was not used"
+        success=false
+    fi
+
+    if [ "$success" = true ]; then
+        pass_test
+    else
+        fail_test "Files not listed in archive order"
+    fi
+
+    rm -rf ordered order.zip order.log cache
+}
+
+# Test 12: Listings do not depend on the dirent cache budget (low-level only)
+test_dirent_cache_budgets() {
+    run_test "Listings identical across dirent_cache_mb budgets"
+
+    # At 1 MB the listing of wide/ never fits and half1/ and half2/ evict
+    # each other; at 64 MB all three stay cached
+    local suffix="-padded-so-the-serialized-listing-takes-more-space.txt"
+    mkdir -p wide half1 half2 listings
+    local i
+    for i in $(seq -w 1 12000); do
+        : > "wide/w$i$suffix"
+    done
+    for i in $(seq -w 1 4000); do
+        : > "half1/a$i$suffix"
+        : > "half2/b$i$suffix"
+    done
+    zip -q -r dirs.zip wide half1 half2
+
+    local budget round dir
+    for budget in 0 1 64; do
+        "$BUILD_DIR/scalable-zip-fs" dirs.zip "$MOUNT_POINT" -f "${FRONTEND_OPTS[@]}" \
+            -o dirent_cache_mb=$budget &
+        local pid=$!
+        sleep 2
+
+        for round in 1 2 3; do
+            for dir in wide half1 half2; do
+                ls -f "$MOUNT_POINT/$dir" | grep -vx '\.\|\.\.' > "listings/$dir.$budget.$round"
+            done
+        done
+
+        fusermount -u "$MOUNT_POINT"
+        wait $pid 2>/dev/null || true
+    done
+
+    # Every listing, in readdir order, equals the uncached one, which holds
+    # exactly the archive's entries
+    local success=true
+    local listing
+    for dir in wide half1 half2; do
+        ls -A "$dir" | LC_ALL=C sort > "listings/$dir.expected"
+        LC_ALL=C sort "listings/$dir.0.1" | cmp -s - "listings/$dir.expected" || success=false
+        for listing in listings/$dir.*.[0-9]; do
+            cmp -s "$listing" "listings/$dir.0.1" || success=false
+        done
+    done
+
+    if [ "$success" = true ]; then
+        pass_test
+    else
+        fail_test "Directory listings differ between dirent_cache_mb budgets"
+    fi
+
+    rm -rf wide half1 half2 listings dirs.zip
+}
+
 # Main execution
 main() {
     echo "======================================"
@@ -341,15 +559,26 @@ main() {
     trap cleanup EXIT
     setup
 
-    # Run all tests
-    test_mount_single_zip
-    test_readonly_enforcement
-    test_directory_traversal
-    test_empty_files
-    test_large_files
-    test_special_characters
-    test_multi_archive
-    test_file_precedence
+    # Run all tests under both frontends
+    for frontend in highlevel lowlevel; do
+        use_frontend "$frontend"
+
+        test_mount_single_zip
+        test_readonly_enforcement
+        test_directory_traversal
+        test_empty_files
+        test_large_files
+        test_special_characters
+        test_multi_archive
+        test_file_precedence
+        test_large_directory
+        test_deflate_random_reads
+        test_offset_listing_order
+    done
+
+    # dirent_cache_mb only applies to the low-level frontend
+    use_frontend lowlevel
+    test_dirent_cache_budgets
 
     # Summary
     echo ""
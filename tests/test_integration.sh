@@ -297,6 +297,307 @@ test_concurrent_mounts() {
     rm -rf shared.txt shared.zip shared_opt.zip mount1 mount2
 }
 
+# Mount `archive` and compare the size and checksum of each file in the
+# arguments that follow with the original; returns non-zero on a mismatch
+verify_mounted_files() {
+    local archive="$1"
+    shift
+
+    "$BUILD_DIR/scalable-zip-fs" "$archive" "$MOUNT_POINT" -f &
+    local pid=$!
+    sleep 2
+
+    local success=true
+    local file
+    for file in "$@"; do
+        if [ "$(stat -c %s "$MOUNT_POINT/$file" 2>/dev/null)" != "$(stat -c %s "$file")" ] ||
+           [ "$(md5sum < "$MOUNT_POINT/$file" 2>/dev/null)" != "$(md5sum < "$file")" ]; then
+            echo "  Mismatch: $file"
+            success=false
+        fi
+    done
+
+    fusermount -u "$MOUNT_POINT"
+    wait $pid 2>/dev/null || true
+
+    [ "$success" = true ]
+}
+
+# Test 7: ZIP64 archives
+test_zip64_archive() {
+    run_test "ZIP64 archive (stored and deflated)"
+
+    mkdir -p zip64
+    dd if=/dev/urandom of=zip64/random.bin bs=1M count=3 2>/dev/null
+    seq 1 500000 > zip64/numbers.txt
+
+    # -fz writes ZIP64 end records, and local headers whose sizes are only in
+    # ZIP64 extra fields, even for small archives
+    zip -q -fz -0 zip64_stored.zip zip64/random.bin zip64/numbers.txt
+    zip -q -fz -9 zip64_deflated.zip zip64/random.bin zip64/numbers.txt
+
+    local success=true
+    verify_mounted_files zip64_stored.zip zip64/random.bin zip64/numbers.txt || success=false
+    verify_mounted_files zip64_deflated.zip zip64/random.bin zip64/numbers.txt || success=false
+
+    if [ "$success" = true ]; then
+        pass_test
+    else
+        fail_test "ZIP64 archive contents differ from the originals"
+    fi
+
+    rm -rf zip64 zip64_stored.zip zip64_deflated.zip
+}
+
+# Test 8: Entries with data descriptors
+test_data_descriptors() {
+    run_test "Streamed archive with data descriptors"
+
+    mkdir -p streamed
+    dd if=/dev/urandom of=streamed/random.bin bs=1M count=3 2>/dev/null
+    seq 1 500000 > streamed/numbers.txt
+    : > streamed/empty.txt
+
+    # Written to a pipe, zip cannot seek back to the local headers, so every
+    # entry's sizes and CRC follow its data in a data descriptor
+    zip -q - streamed/random.bin streamed/numbers.txt streamed/empty.txt | cat > streamed.zip
+    zip -q -0 - streamed/random.bin streamed/numbers.txt streamed/empty.txt | cat > streamed_stored.zip
+
+    local success=true
+    verify_mounted_files streamed.zip streamed/random.bin streamed/numbers.txt streamed/empty.txt || success=false
+    verify_mounted_files streamed_stored.zip streamed/random.bin streamed/numbers.txt streamed/empty.txt ||
+        success=false
+
+    if [ "$success" = true ]; then
+        pass_test
+    else
+        fail_test "Streamed archive contents differ from the originals"
+    fi
+
+    rm -rf streamed streamed.zip streamed_stored.zip
+}
+
+# Little-endian fields for hand-built archives, as printf %b escapes
+le16() { printf '\\x%02x\\x%02x' $(($1 & 255)) $((($1 >> 8) & 255)); }
+le32() { le16 $(($1 & 65535)); le16 $((($1 >> 16) & 65535)); }
+le64() { le32 $(($1 & 4294967295)); le32 $((($1 >> 32) & 4294967295)); }
+
+# Write a one-entry archive whose ZIP64 extra field claims `size` bytes of
+# data, stored or deflated per `method`; only 16 bytes actually follow
+write_zip64_archive() {
+    local out="$1" method="$2" size="$3"
+    local name="evil.bin"
+    local extra
+    extra="$(le16 1)$(le16 16)$(le64 "$size")$(le64 "$size")"
+
+    {
+        # Local header, data
+        printf '%b' "$(le32 0x04034b50)$(le16 45)$(le16 0)$(le16 "$method")$(le32 0)$(le32 0)"
+        printf '%b' "$(le32 0xFFFFFFFF)$(le32 0xFFFFFFFF)$(le16 ${#name})$(le16 20)"
+        printf '%s' "$name"
+        printf '%b' "$extra"
+        printf 'AAAAAAAAAAAAAAAA'
+
+        # Central directory
+        printf '%b' "$(le32 0x02014b50)$(le16 45)$(le16 45)$(le16 0)$(le16 "$method")$(le32 0)$(le32 0)"
+        printf '%b' "$(le32 0xFFFFFFFF)$(le32 0xFFFFFFFF)$(le16 ${#name})$(le16 20)$(le16 0)"
+        printf '%b' "$(le16 0)$(le16 0)$(le32 0)$(le32 0)"
+        printf '%s' "$name"
+        printf '%b' "$extra"
+
+        # End of central directory
+        printf '%b' "$(le32 0x06054b50)$(le16 0)$(le16 0)$(le16 1)$(le16 1)"
+        printf '%b' "$(le32 $((46 + ${#name} + 20)))$(le32 $((30 + ${#name} + 20 + 16)))$(le16 0)"
+    } > "$out"
+}
+
+# Test 9: Malformed ZIP64 sizes
+test_zip64_size_overflow() {
+    run_test "ZIP64 entries whose sizes overflow the archive are skipped"
+
+    # Sizes near 2^64 wrap around when added to the data offset, so a naive
+    # bounds check lets them through and mmap reads run off the mapping
+    write_zip64_archive overflow_stored.zip 0 0xFFFFFFFFFFFFFFF0
+    write_zip64_archive overflow_deflated.zip 8 0xFFFFFFFFFFFFFFF0
+    mkdir -p overflow_src
+    echo "still served" > overflow_src/good.txt
+    rm -f overflow_good.zip
+    (cd overflow_src && zip -q -0 ../overflow_good.zip good.txt)
+    tree_checksums overflow_src > expected.md5
+
+    # The bad entries are left out; the rest of the mount works
+    local success=true
+    mount_checksums overflow.md5 overflow.log overflow_good.zip overflow_stored.zip overflow_deflated.zip \
+        -o read_mode=mmap || success=false
+    if ! cmp -s expected.md5 overflow.md5; then
+        echo "  Mounted files differ from the valid entries"
+        success=false
+    fi
+    if [ "$(grep -c "Invalid entries skipped: 1" overflow.log)" -ne 2 ]; then
+        echo "  Skipped entries not reported per archive"
+        success=false
+    fi
+
+    if [ "$success" = true ]; then
+        pass_test
+    else
+        fail_test "Out-of-bounds ZIP64 entries were not skipped cleanly"
+    fi
+
+    rm -rf overflow_src overflow_good.zip overflow_stored.zip overflow_deflated.zip
+}
+
+# Checksums of every file under directory `1`, by relative path
+tree_checksums() {
+    (cd "$1" && find . -type f -print0 | sort -z | xargs -0 -r md5sum)
+}
+
+# Mount `archive` with the mount options that follow, write the checksums
+# of its files to `out` and the daemon's stderr to `log`; returns non-zero
+# if the daemon did not stay up until the unmount
+mount_checksums() {
+    local out="$1" log="$2" archive="$3"
+    shift 3
+
+    "$BUILD_DIR/scalable-zip-fs" "$archive" "$MOUNT_POINT" -f "$@" 2>"$log" &
+    local pid=$!
+    sleep 2
+
+    tree_checksums "$MOUNT_POINT" > "$out" 2>/dev/null || true
+
+    local alive=true
+    kill -0 $pid 2>/dev/null || alive=false
+    fusermount -u "$MOUNT_POINT" 2>/dev/null || true
+    wait $pid 2>/dev/null || true
+
+    [ "$alive" = true ]
+}
+
+# Build the sample archive for the index cache tests from `snap_src`
+make_snapshot_archive() {
+    rm -f snap.zip
+    (cd snap_src && zip -q -r ../snap.zip . -x 'big/*' && zip -q -r -0 ../snap.zip big)
+}
+
+# Test 10: Index snapshot reuse
+test_index_cache_reuse() {
+    run_test "Second mount reuses the index snapshot"
+
+    mkdir -p snap_src/docs/nested snap_src/big cache
+    for i in {1..200}; do
+        echo "document $i" > "snap_src/docs/doc_$i.txt"
+    done
+    seq 1 100000 > snap_src/docs/nested/numbers.txt
+    dd if=/dev/urandom of=snap_src/big/blob.bin bs=1M count=2 2>/dev/null
+    make_snapshot_archive
+    tree_checksums snap_src > expected.md5
+
+    local success=true
+    mount_checksums first.md5 first.log snap.zip -o index_cache=cache || success=false
+    mount_checksums second.md5 second.log snap.zip -o index_cache=cache || success=false
+    if [ -z "$(ls cache/*.idx 2>/dev/null)" ]; then
+        echo "  No snapshot written"
+        success=false
+    fi
+    if grep -q "from snapshot" first.log || ! grep -q "from snapshot" second.log; then
+        echo "  Snapshot not used on the second mount only"
+        success=false
+    fi
+    if ! cmp -s expected.md5 first.md5 || ! cmp -s expected.md5 second.md5; then
+        echo "  Contents differ"
+        success=false
+    fi
+
+    if [ "$success" = true ]; then
+        pass_test
+    else
+        fail_test "Index snapshot was not reused with identical contents"
+    fi
+}
+
+# Test 11: Stale index snapshot
+test_index_cache_stale() {
+    run_test "Snapshot of a replaced archive is rejected"
+
+    # Same path, new contents and mtime; the old snapshot is still in cache/
+    rm -rf snap_src/docs/nested
+    echo "added after the snapshot" > snap_src/docs/new.txt
+    echo "changed" > snap_src/docs/doc_1.txt
+    sleep 1
+    make_snapshot_archive
+    tree_checksums snap_src > expected.md5
+
+    local success=true
+    mount_checksums stale.md5 stale.log snap.zip -o index_cache=cache || success=false
+    mount_checksums fresh.md5 fresh.log snap.zip -o index_cache=cache || success=false
+    if grep -q "from snapshot" stale.log; then
+        echo "  Stale snapshot was used"
+        success=false
+    fi
+    if ! grep -q "from snapshot" fresh.log; then
+        echo "  Replacement snapshot was not used"
+        success=false
+    fi
+    if ! cmp -s expected.md5 stale.md5 || ! cmp -s expected.md5 fresh.md5; then
+        echo "  Contents differ from the new archive"
+        success=false
+    fi
+
+    if [ "$success" = true ]; then
+        pass_test
+    else
+        fail_test "Stale index snapshot handling failed"
+    fi
+}
+
+# Test 12: Damaged index snapshot
+test_index_cache_damaged() {
+    run_test "Truncated or corrupted snapshot falls back to a fresh index"
+
+    local snapshot
+    snapshot="$(ls cache/*.idx | head -n 1)"
+    local size
+    size=$(stat -c %s "$snapshot")
+
+    local success=true
+    local damage
+    for damage in truncate-header truncate-arrays header garbage; do
+        # Each case starts from a good snapshot of the current archive
+        mount_checksums /dev/null rebuild.log snap.zip -o index_cache=cache || success=false
+        snapshot="$(ls cache/*.idx | head -n 1)"
+        case "$damage" in
+            truncate-header) truncate -s 16 "$snapshot" ;;
+            truncate-arrays) truncate -s $((size / 2)) "$snapshot" ;;
+            header) dd if=/dev/urandom of="$snapshot" bs=64 count=1 conv=notrunc 2>/dev/null ;;
+            garbage) dd if=/dev/urandom of="$snapshot" bs=1 count=4096 seek=$((size / 3)) conv=notrunc \
+                         2>/dev/null ;;
+        esac
+
+        if ! mount_checksums damaged.md5 damaged.log snap.zip -o index_cache=cache; then
+            echo "  Daemon did not stay up: $damage"
+            success=false
+        fi
+        if grep -q "from snapshot" damaged.log && [ "$damage" != garbage ]; then
+            echo "  Damaged snapshot was used: $damage"
+            success=false
+        fi
+        # Garbage inside the arrays may pass the bounds checks; it only
+        # must not take the daemon down
+        if [ "$damage" != garbage ] && ! cmp -s expected.md5 damaged.md5; then
+            echo "  Contents differ after fallback: $damage"
+            success=false
+        fi
+    done
+
+    if [ "$success" = true ]; then
+        pass_test
+    else
+        fail_test "Damaged index snapshot was not handled"
+    fi
+
+    rm -rf snap_src snap.zip cache ./*.md5 ./*.log
+}
+
 # Main execution
 main() {
     echo "================================================"
@@ -313,6 +614,12 @@ main() {
     test_large_dataset
     test_mixed_compression
     test_concurrent_mounts
+    test_zip64_archive
+    test_data_descriptors
+    test_zip64_size_overflow
+    test_index_cache_reuse
+    test_index_cache_stale
+    test_index_cache_damaged
 
     # Summary
     echo ""